@@ -0,0 +1,155 @@
+/****************************************
+ * alert.c
+ * rev 1.0 Oct 2026
+ * SMBALERT# handling, with Alert Response Address reads from the GPIO interrupt
+ * **************************************/
+
+#include "alert.h"
+#include "buslock.h"
+#include "gpioirq.h"
+#include "sampler.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+
+static uint8_t alert_active = 0;
+static uint8_t alert_gpio;
+static int alert_reg;
+static uint8_t alert_len;
+static uint16_t alert_events;
+static uint16_t alert_lost;
+static volatile uint8_t alert_pend = 0;
+static uint8_t alert_stuck = 0; // nothing answered the ARA, don't report again until the line is released
+
+// queues one event; the sequence number counts events, including lost ones
+static void
+alert_event(const uint8_t *data, uint8_t len, uint32_t now)
+{
+    if (!sampler_push(SAMPLER_ALERT_SOURCE, alert_events, alert_lost, data, len, now)) {
+        alert_lost++;
+    }
+    alert_events++;
+}
+
+// reads the status bytes from the alerting device into buf, returns the number read (0 on failure)
+static uint8_t
+alert_read_status(uint8_t addr, uint8_t *buf)
+{
+    uint8_t r;
+    if (alert_len == 0) {
+        return 0;
+    }
+    if (alert_reg >= 0) {
+        r = (uint8_t) alert_reg;
+        if (i2c_write_timeout_us(i2c_port, addr, &r, 1, true, ALERT_I2C_TIMEOUT_US) < 0) {
+            i2c_port->restart_on_next = false;
+            return 0;
+        }
+    }
+    if (i2c_read_timeout_us(i2c_port, addr, buf, alert_len, false, ALERT_I2C_TIMEOUT_US) < 0) {
+        return 0;
+    }
+    return alert_len;
+}
+
+// the caller makes sure the bus is free. Each ARA read is answered by the alerting device with the
+// lowest address, which then releases the line; if the line is still low another device is alerting.
+// A device that answers twice in a row is holding the line, so the pass stops there
+void
+alert_service(void)
+{
+    uint8_t data[1 + ALERT_MAX_STATUS_LEN];
+    uint8_t ara;
+    int last = -1;
+    int i;
+    uint32_t now = time_us_32();
+    alert_pend = 0;
+    if (!alert_active) {
+        return;
+    }
+    for (i = 0; (i < ALERT_MAX_DEVICES) && !gpio_get(alert_gpio); i++) {
+        if (i2c_read_timeout_us(i2c_port, ALERT_ARA_ADDR, &ara, 1, false, ALERT_I2C_TIMEOUT_US) < 0) {
+            if ((i == 0) && !alert_stuck) {
+                alert_stuck = 1;
+                data[0] = ALERT_NO_RESPONSE;
+                alert_event(data, 1, now);
+            }
+            return;
+        }
+        alert_stuck = 0;
+        data[0] = ara >> 1; // the device sends its address in the upper 7 bits
+        if (data[0] == last) {
+            return;
+        }
+        last = data[0];
+        alert_event(data, (uint8_t) (1 + alert_read_status(data[0], &data[1])), now);
+    }
+}
+
+static void
+alert_gpio_cb(unsigned int gpio, uint32_t events)
+{
+    if (events & GPIO_IRQ_EDGE_RISE) {
+        alert_stuck = 0;
+    }
+    if (events & GPIO_IRQ_EDGE_FALL) {
+        if (i2c_bus_free_for_irq()) {
+            alert_service();
+        } else {
+            alert_pend = 1;
+        }
+    }
+}
+
+int
+alert_start(uint8_t gpio, int status_reg, uint8_t status_len)
+{
+    // a pin used by a trigger is left alone, and so is the current watch
+    if ((status_len > ALERT_MAX_STATUS_LEN) || (status_reg > 255) || !gpioirq_available(gpio, alert_gpio_cb)) {
+        return 0;
+    }
+    alert_stop();
+    alert_reg = status_reg;
+    alert_len = status_len;
+    alert_events = 0;
+    alert_lost = 0;
+    alert_stuck = 0;
+    alert_gpio = gpio;
+    gpio_init(gpio);
+    gpio_set_dir(gpio, GPIO_IN);
+    gpio_pull_up(gpio); // SMBALERT# is open-drain
+    gpioirq_attach(gpio, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE, alert_gpio_cb);
+    alert_active = 1;
+    if (!gpio_get(gpio)) {
+        alert_pend = 1; // already asserted, there won't be an edge
+    }
+    return 1;
+}
+
+void
+alert_stop(void)
+{
+    if (!alert_active) {
+        return;
+    }
+    gpioirq_detach(alert_gpio, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE);
+    alert_active = 0;
+    alert_pend = 0;
+}
+
+int
+alert_pending(void)
+{
+    return alert_pend;
+}
+
+int
+alert_status(uint8_t *gpio, uint16_t *events, uint16_t *lost)
+{
+    if (!alert_active) {
+        return 0;
+    }
+    *gpio = alert_gpio;
+    *events = alert_events;
+    *lost = alert_lost;
+    return 1;
+}
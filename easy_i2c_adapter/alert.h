@@ -0,0 +1,30 @@
+#ifndef _ALERT_HEADER_FILE_
+#define _ALERT_HEADER_FILE_
+
+/***********************************
+ * alert.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+#define ALERT_ARA_ADDR 0x0C // SMBus Alert Response Address
+#define ALERT_MAX_STATUS_LEN 4
+#define ALERT_MAX_DEVICES 8 // ARA reads per pass while the line stays low
+#define ALERT_NO_RESPONSE 0xFF // event address when the line is low but nothing answers the ARA
+#define ALERT_I2C_TIMEOUT_US 2000
+
+// watches gpio (active low, open-drain) for SMBALERT#. On each falling edge the alerting devices are found
+// with Alert Response Address reads; for each one, status_len bytes are read from it (writing status_reg
+// first unless it is -1), and an event is queued with the samples: job SAMPLER_ALERT_SOURCE,
+// data = device address followed by the status bytes. Returns 1 on success
+int alert_start(uint8_t gpio, int status_reg, uint8_t status_len);
+void alert_stop(void);
+// returns 1 if an alert arrived while the bus was in use; the main loop then calls alert_service
+// with the bus held
+int alert_pending(void);
+void alert_service(void);
+// for alert?; returns 0 if not watching, otherwise sets the counts of events and lost events
+int alert_status(uint8_t *gpio, uint16_t *events, uint16_t *lost);
+
+#endif // _ALERT_HEADER_FILE_
@@ -0,0 +1,43 @@
+#ifndef _BUSLOCK_HEADER_FILE_
+#define _BUSLOCK_HEADER_FILE_
+
+/***********************************
+ * buslock.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+#include "wave.h"
+
+// the command path and the interrupt-driven engines share one I2C port.
+// i2c_bus_busy is set by the main loop while it processes commands; interrupt handlers
+// must check i2c_bus_free_for_irq() and skip their transfer if it returns 0
+extern volatile uint8_t i2c_bus_busy;
+extern i2c_inst_t *i2c_port;
+
+// also checks that the bus isn't being held for a repeated start (send+hold),
+// and that waveform playback isn't sending a sample
+static inline int i2c_bus_free_for_irq(void) {
+    return (i2c_bus_busy == 0) && (!i2c_port->restart_on_next) && (!wave_bus_active());
+}
+
+#define I2C_ABORT_TIMEOUT_US 2000
+
+// ends a transfer that was driven through the data command register and has stalled: the block
+// flushes its TX FIFO and sends a stop, so that reads queued without a stop don't leave SCL held low
+static inline void i2c_abort_transfer(i2c_inst_t *i2c) {
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+    uint64_t deadline = time_us_64() + I2C_ABORT_TIMEOUT_US;
+    hw->enable = I2C_IC_ENABLE_ABORT_BITS | I2C_IC_ENABLE_ENABLE_BITS;
+    while ((hw->enable & I2C_IC_ENABLE_ABORT_BITS) && (time_us_64() < deadline)) {
+        tight_loop_contents();
+    }
+    hw->enable = 0; // also empties the FIFOs; the next transfer enables the block again
+    (void) hw->clr_tx_abrt;
+    (void) hw->clr_stop_det;
+    i2c->restart_on_next = false;
+}
+
+#endif // _BUSLOCK_HEADER_FILE_
@@ -0,0 +1,171 @@
+/****************************************
+ * config.c
+ * rev 1.0 Oct 2026
+ * adapter settings stored in flash
+ * **************************************/
+
+#include <stddef.h>
+#include <string.h>
+#include "config.h"
+#include "crc.h"
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+_Static_assert(sizeof(config_t) == CONFIG_RECORD_SIZE, "config record must fill one flash page");
+
+static config_t config;
+static int slot_current = -1; // slot holding the record that was loaded or last saved, -1 if none
+
+static const config_t *
+slot_ptr(int slot)
+{
+    return (const config_t *) (uintptr_t) (XIP_BASE + CONFIG_FLASH_OFFSET + (uint32_t) slot * CONFIG_RECORD_SIZE);
+}
+
+static uint32_t
+record_crc(const config_t *cfg)
+{
+    return crc32_update(CRC32_INIT, (const uint8_t *) cfg, offsetof(config_t, crc)) ^ CRC32_XOROUT;
+}
+
+static int
+slot_valid(int slot)
+{
+    const config_t *rec = slot_ptr(slot);
+    return (rec->magic == CONFIG_MAGIC) && (rec->crc == record_crc(rec));
+}
+
+static int
+slot_blank(int slot)
+{
+    const uint32_t *w = (const uint32_t *) slot_ptr(slot);
+    uint32_t i;
+    for (i = 0; i < CONFIG_RECORD_SIZE / 4; i++) {
+        if (w[i] != 0xFFFFFFFF) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void
+config_defaults(config_t *cfg)
+{
+    memset(cfg, 0, sizeof(config_t));
+    cfg->magic = CONFIG_MAGIC;
+    cfg->m2m = 0;
+    cfg->echo = 1;
+    cfg->pullups = 1;
+    cfg->board_id = CONFIG_BOARD_ID_PINS;
+    cfg->i2c_baud = 100 * 1000;
+}
+
+void
+config_load(void)
+{
+    int slot;
+    slot_current = -1;
+    for (slot = 0; slot < CONFIG_SLOTS; slot++) {
+        if (slot_valid(slot) && ((slot_current < 0) || (slot_ptr(slot)->seq > slot_ptr(slot_current)->seq))) {
+            slot_current = slot;
+        }
+    }
+    if (slot_current < 0) {
+        config_defaults(&config);
+        return;
+    }
+    memcpy(&config, slot_ptr(slot_current), sizeof(config_t));
+    config.macro[CONFIG_MACRO_MAX - 1] = 0;
+}
+
+config_t *
+config_get(void)
+{
+    return &config;
+}
+
+// flash can't be read while it is being written, so nothing may run from it meanwhile;
+// the SDK flash routines run from RAM, and interrupts are held off
+static void
+sector_erase(int sector)
+{
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_erase(CONFIG_FLASH_OFFSET + (uint32_t) sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+    restore_interrupts(ints);
+}
+
+static void
+slot_program(int slot, const config_t *rec)
+{
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_program(CONFIG_FLASH_OFFSET + (uint32_t) slot * CONFIG_RECORD_SIZE, (const uint8_t *) rec, CONFIG_RECORD_SIZE);
+    restore_interrupts(ints);
+}
+
+// the slot for the next record: after the current one in the same sector, skipping partly written slots.
+// When the log reaches the other sector, that sector is erased first
+static int
+next_slot(void)
+{
+    int slot = slot_current + 1;
+    int i;
+    for (;;) {
+        if (slot >= CONFIG_SLOTS) {
+            slot = 0;
+        }
+        if ((slot % CONFIG_SLOTS_PER_SECTOR) == 0) {
+            for (i = slot; i < slot + CONFIG_SLOTS_PER_SECTOR; i++) {
+                if (!slot_blank(i)) {
+                    sector_erase(slot / CONFIG_SLOTS_PER_SECTOR);
+                    break;
+                }
+            }
+            return slot;
+        }
+        if (slot_blank(slot)) {
+            return slot;
+        }
+        slot++;
+    }
+}
+
+int
+config_save(void)
+{
+    int slot;
+    config.magic = CONFIG_MAGIC;
+    config.seq = (slot_current < 0) ? 1 : slot_ptr(slot_current)->seq + 1;
+    config.crc = record_crc(&config);
+    slot = next_slot();
+    slot_program(slot, &config);
+    if (!slot_valid(slot)) {
+        return 0;
+    }
+    slot_current = slot;
+    return 1;
+}
+
+void
+config_reset(void)
+{
+    int sector;
+    for (sector = 0; sector < CONFIG_SECTORS; sector++) {
+        sector_erase(sector);
+    }
+    slot_current = -1;
+    config_defaults(&config);
+}
+
+int
+config_slots_used(void)
+{
+    int slot;
+    int n = 0;
+    for (slot = 0; slot < CONFIG_SLOTS; slot++) {
+        if (!slot_blank(slot)) {
+            n++;
+        }
+    }
+    return n;
+}
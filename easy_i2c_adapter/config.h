@@ -0,0 +1,50 @@
+#ifndef _CONFIG_HEADER_FILE_
+#define _CONFIG_HEADER_FILE_
+
+/***********************************
+ * config.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+#include "hardware/flash.h"
+
+// the settings are kept in the last two sectors of flash, as a log of 256-byte records (one flash page each).
+// A sector is only erased when the log moves into it, and never while it holds the current record,
+// so an interrupted save or erase always leaves the previous settings in place
+#define CONFIG_SECTORS 2
+#define CONFIG_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - CONFIG_SECTORS * FLASH_SECTOR_SIZE)
+#define CONFIG_RECORD_SIZE FLASH_PAGE_SIZE
+#define CONFIG_SLOTS_PER_SECTOR (FLASH_SECTOR_SIZE / CONFIG_RECORD_SIZE)
+#define CONFIG_SLOTS (CONFIG_SECTORS * CONFIG_SLOTS_PER_SECTOR)
+#define CONFIG_MAGIC 0x47464345 // "ECFG"
+#define CONFIG_MACRO_MAX 236
+#define CONFIG_BOARD_ID_PINS 0xff // board ID comes from the ADDR0-2 pins
+#define CONFIG_BAUD_MIN 10000
+#define CONFIG_BAUD_MAX 1000000
+
+typedef struct config_s {
+    uint32_t magic;
+    uint32_t seq; // incremented on each save, the valid record with the highest seq is current
+    uint8_t m2m; // start with M2M responses on
+    uint8_t echo; // start with echo on
+    uint8_t pullups; // enable the internal pull-ups on SDA and SCL
+    uint8_t board_id; // 0-127, or CONFIG_BOARD_ID_PINS
+    uint32_t i2c_baud;
+    char macro[CONFIG_MACRO_MAX]; // commands run at startup, separated by ';'. NUL-terminated
+    uint32_t crc; // CRC-32 of everything before it
+} config_t;
+
+// finds the newest valid record in flash, or uses the defaults if there is none. Call once at startup
+void config_load(void);
+// the settings in use; changes are made to this copy and only reach flash with config_save
+config_t *config_get(void);
+void config_defaults(config_t *cfg);
+// writes the current settings to the next free slot, erasing the other sector when the current one is full.
+// Returns 1 on success
+int config_save(void);
+// erases the stored settings, so the defaults are used from the next startup, and restores them now
+void config_reset(void);
+int config_slots_used(void); // number of records in the log
+
+#endif // _CONFIG_HEADER_FILE_
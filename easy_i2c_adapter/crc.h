@@ -0,0 +1,25 @@
+#ifndef _CRC_HEADER_FILE_
+#define _CRC_HEADER_FILE_
+
+/***********************************
+ * crc.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+// CRC-32: start with CRC32_INIT, update any number of times, then XOR with CRC32_XOROUT
+#define CRC32_INIT 0xFFFFFFFF
+#define CRC32_XOROUT 0xFFFFFFFF
+// CRC-16/CCITT-FALSE: start with CRC16_INIT, no final XOR
+#define CRC16_INIT 0xFFFF
+// CRC-8 as used for the SMBus PEC: start with 0, no final XOR
+#define CRC8_INIT 0x00
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *buf, uint32_t len);
+uint16_t crc16_update(uint16_t crc, const uint8_t *buf, uint32_t len);
+uint8_t crc8_update(uint8_t crc, const uint8_t *buf, uint32_t len);
+// a single byte, for computing the PEC as bytes go on the wire
+uint8_t crc8_byte(uint8_t crc, uint8_t b);
+
+#endif // _CRC_HEADER_FILE_
@@ -0,0 +1,121 @@
+/****************************************
+ * eeprom.c
+ * rev 1.0 Oct 2026
+ * 24Cxx style EEPROM page writer
+ * **************************************/
+
+#include "eeprom.h"
+#include "memops.h"
+#include "pico/stdlib.h"
+
+static i2c_inst_t *ee_i2c;
+static uint8_t ee_devaddr;
+static uint8_t ee_awidth;
+static uint16_t ee_pagesize;
+static uint32_t ee_addr; // memory address of the next byte to be buffered
+static uint32_t ee_total;
+static uint32_t ee_written;
+static uint64_t ee_start_time;
+static uint64_t ee_end_time;
+static uint8_t ee_buf[EEPROM_MAX_PAGE + 2]; // address bytes followed by page data
+static uint16_t ee_buf_len = 0; // number of data bytes buffered
+
+int
+i2c_ack_poll(i2c_inst_t *i2c, uint8_t devaddr, uint32_t timeout_us)
+{
+    uint8_t dummy;
+    uint64_t end = time_us_64() + timeout_us;
+    // the I2C block can't issue a zero-length transfer, so the shortest probe is a single byte read,
+    // which for an EEPROM is a harmless current-address read
+    do {
+        if (i2c_read_timeout_us(i2c, devaddr, &dummy, 1, false, 1000) == 1) {
+            return 1;
+        }
+    } while (time_us_64() < end);
+    return 0;
+}
+
+int
+eeprom_begin(i2c_inst_t *i2c, uint8_t devaddr, uint32_t start, uint8_t awidth, uint16_t pagesize, uint32_t total)
+{
+    if ((awidth < 1) || (awidth > 2) || (pagesize == 0) || (pagesize > EEPROM_MAX_PAGE) || (total == 0)) {
+        return 0;
+    }
+    ee_i2c = i2c;
+    ee_devaddr = devaddr;
+    ee_addr = start;
+    ee_awidth = awidth;
+    ee_pagesize = pagesize;
+    ee_total = total;
+    ee_written = 0;
+    ee_buf_len = 0;
+    ee_start_time = time_us_64();
+    ee_end_time = ee_start_time;
+    return 1;
+}
+
+// writes the buffered page, then waits for the internal write cycle to complete
+static int
+eeprom_write_page(void)
+{
+    uint32_t page_addr = ee_addr - ee_buf_len;
+    uint8_t dev;
+    uint8_t *p;
+    int retval;
+    dev = mem_dev_addr(ee_devaddr, page_addr, ee_awidth);
+    if (ee_awidth == 2) {
+        ee_buf[0] = (page_addr >> 8) & 0xff;
+        ee_buf[1] = page_addr & 0xff;
+        p = ee_buf;
+    } else {
+        ee_buf[1] = page_addr & 0xff;
+        p = &ee_buf[1];
+    }
+    retval = i2c_write_blocking(ee_i2c, dev, p, ee_awidth + ee_buf_len, false);
+    if (retval == PICO_ERROR_GENERIC) {
+        return 0;
+    }
+    if (!i2c_ack_poll(ee_i2c, dev, EEPROM_ACK_POLL_TIMEOUT_US)) {
+        return 0;
+    }
+    ee_written += ee_buf_len;
+    ee_buf_len = 0;
+    return 1;
+}
+
+int
+eeprom_put_byte(uint8_t b)
+{
+    ee_buf[2 + ee_buf_len] = b;
+    ee_buf_len++;
+    ee_addr++;
+    if (((ee_addr % ee_pagesize) == 0) || (ee_written + ee_buf_len == ee_total)) {
+        if (!eeprom_write_page()) {
+            ee_end_time = time_us_64();
+            return EEPROM_RESULT_ERROR;
+        }
+    }
+    if (ee_written == ee_total) {
+        ee_end_time = time_us_64();
+        return EEPROM_RESULT_DONE;
+    }
+    return EEPROM_RESULT_MORE;
+}
+
+uint32_t
+eeprom_bytes_written(void)
+{
+    return ee_written;
+}
+
+uint32_t
+eeprom_bytes_received(void)
+{
+    return ee_written + ee_buf_len;
+}
+
+uint64_t
+eeprom_elapsed_us(void)
+{
+    return ee_end_time - ee_start_time;
+}
@@ -0,0 +1,28 @@
+#ifndef _EEPROM_HEADER_FILE_
+#define _EEPROM_HEADER_FILE_
+
+/***********************************
+ * eeprom.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+#include "hardware/i2c.h"
+
+#define EEPROM_MAX_PAGE 256
+#define EEPROM_ACK_POLL_TIMEOUT_US 20000
+#define EEPROM_RESULT_ERROR 0
+#define EEPROM_RESULT_MORE 1
+#define EEPROM_RESULT_DONE 2
+
+// returns 1 if parameters are acceptable
+int eeprom_begin(i2c_inst_t *i2c, uint8_t devaddr, uint32_t start, uint8_t awidth, uint16_t pagesize, uint32_t total);
+// buffers one data byte, writing a page whenever a page boundary or the end of data is reached
+int eeprom_put_byte(uint8_t b); // returns one of EEPROM_RESULT_*
+uint32_t eeprom_bytes_written(void);
+uint32_t eeprom_bytes_received(void); // written plus buffered
+uint64_t eeprom_elapsed_us(void);
+// polls the device until it acknowledges its address, returns 1 on success, 0 on timeout
+int i2c_ack_poll(i2c_inst_t *i2c, uint8_t devaddr, uint32_t timeout_us);
+
+#endif // _EEPROM_HEADER_FILE_
@@ -0,0 +1,57 @@
+/****************************************
+ * gpioirq.c
+ * rev 1.0 Oct 2026
+ * shared GPIO interrupt callback, dispatching to a handler per pin
+ * **************************************/
+
+#include "gpioirq.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+
+static gpioirq_handler_t handlers[GPIOIRQ_NUM_PINS];
+static uint32_t pin_edges[GPIOIRQ_NUM_PINS];
+static uint8_t installed = 0;
+
+static void
+gpioirq_dispatch(unsigned int gpio, uint32_t events)
+{
+    if ((gpio < GPIOIRQ_NUM_PINS) && (handlers[gpio] != NULL)) {
+        handlers[gpio](gpio, events);
+    }
+}
+
+int
+gpioirq_available(unsigned int gpio, gpioirq_handler_t handler)
+{
+    return (gpio < GPIOIRQ_NUM_PINS) && ((handlers[gpio] == NULL) || (handlers[gpio] == handler));
+}
+
+int
+gpioirq_attach(unsigned int gpio, uint32_t edges, gpioirq_handler_t handler)
+{
+    if (!gpioirq_available(gpio, handler)) {
+        return 0;
+    }
+    handlers[gpio] = handler;
+    pin_edges[gpio] |= edges;
+    if (!installed) {
+        installed = 1;
+        gpio_set_irq_enabled_with_callback(gpio, edges, true, gpioirq_dispatch);
+    } else {
+        gpio_set_irq_enabled(gpio, edges, true);
+    }
+    return 1;
+}
+
+void
+gpioirq_detach(unsigned int gpio, uint32_t edges)
+{
+    if ((gpio >= GPIOIRQ_NUM_PINS) || (handlers[gpio] == NULL)) {
+        return;
+    }
+    gpio_set_irq_enabled(gpio, edges, false);
+    pin_edges[gpio] &= ~edges;
+    if (pin_edges[gpio] == 0) {
+        handlers[gpio] = NULL;
+    }
+}
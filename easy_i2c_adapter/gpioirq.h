@@ -0,0 +1,25 @@
+#ifndef _GPIOIRQ_HEADER_FILE_
+#define _GPIOIRQ_HEADER_FILE_
+
+/***********************************
+ * gpioirq.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+#define GPIOIRQ_NUM_PINS 30
+
+// the SDK has a single GPIO interrupt callback, so the modules that use GPIO edges register
+// a handler per pin here instead, and one shared callback passes each event on
+typedef void (*gpioirq_handler_t)(unsigned int gpio, uint32_t events);
+
+// enables the GPIO_IRQ_EDGE_* events in edges on gpio, calling handler in interrupt context.
+// Returns 0 if the pin is invalid, or is already used by a different handler
+int gpioirq_attach(unsigned int gpio, uint32_t edges, gpioirq_handler_t handler);
+// returns 1 if gpio is free, or already used by handler, so that a caller can check before configuring the pin
+int gpioirq_available(unsigned int gpio, gpioirq_handler_t handler);
+// disables the events in edges; the pin is released once it has no events left
+void gpioirq_detach(unsigned int gpio, uint32_t edges);
+
+#endif // _GPIOIRQ_HEADER_FILE_
@@ -6,8 +6,26 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "pico/stdlib.h"
 #include "extrafunc.h"
+#include "regcache.h"
+#include "eeprom.h"
+#include "memops.h"
+#include "crc.h"
+#include "config.h"
+#include "script.h"
+#include "vm.h"
+#include "smbus.h"
+#include "mux.h"
+#include "parse.h"
+#include "resp.h"
+#include "usbio.h"
+#include "buslock.h"
+#include "sampler.h"
+#include "alert.h"
+#include "scheduler.h"
+#include "wave.h"
 #include "hardware/gpio.h"
 #include "hardware/i2c.h"
 
@@ -18,61 +36,111 @@
 #define BOARD_ADDR0_PIN 2
 #define BOARD_ADDR1_PIN 3
 #define BOARD_ADDR2_PIN 4
+#define UART_LINE_MAX 300 // interactive line editing only; streamed input has no line limit
+#define TOKEN_MAX 64
 #define MODE_ASCII 0
 #define MODE_BIN 1
-#define TOKEN_RESULT_ERROR 0
-#define TOKEN_RESULT_OK 1
-#define TOKEN_RESULT_LINE_COMPLETE 2
+#define TOKEN_RESULT_ERROR 0 // the rest of the line is skipped
+#define TOKEN_RESULT_OK 1 // the command continues with the following tokens
+#define TOKEN_RESULT_CMD_COMPLETE 2 // the next token is a new command
 #define M2M_RESPONSE_OK_CHAR '.'
 #define M2M_RESPONSE_CONTINUE_CHAR '&'
 #define M2M_RESPONSE_ERR_CHAR 'X'
 #define M2M_RESPONSE_PROT_ERR_CHAR '~'
+#define M2M_RESPONSE_PEC_ERR_CHAR '!' // SMBus PEC mismatch
+#define PROBE_QUICK 0 // SMBus quick read: address with the read bit, then stop
+#define PROBE_WRITE0 1 // zero-length write (SMBus quick write)
+#define PROBE_READ 2 // read one byte using the I2C block
+#define PROBE_TIMEOUT_US 2000
 #define TOKEN_PROGRESS_NONE 0
 #define TOKEN_PROGRESS_SEND 1
 #define TOKEN_PROGRESS_RECV 2
-#define COL_RED printf("\033[31m")
-#define COL_GREEN printf("\033[32m")
-#define COL_YELLOW printf("\033[33m")
-#define COL_BLUE printf("\033[34m")
-#define COL_MAGENTA printf("\033[35m")
-#define COL_CYAN printf("\033[36m")
-#define COL_RESET printf("\033[0m")
+#define TOKEN_PROGRESS_EEPROM 3
+#define TOKEN_PROGRESS_PATTERN 4
+#define TOKEN_PROGRESS_WAVE 5
+#define TOKEN_PROGRESS_VM 6
+#define TOKEN_PROGRESS_SMBUS 7
+#define SCRIPT_RESULT_MAX 400 // collected output of the commands in a script
+#define DELAY_MAX_US 10000000
+#define COL_RED resp_puts("\033[31m")
+#define COL_GREEN resp_puts("\033[32m")
+#define COL_YELLOW resp_puts("\033[33m")
+#define COL_BLUE resp_puts("\033[34m")
+#define COL_MAGENTA resp_puts("\033[35m")
+#define COL_CYAN resp_puts("\033[36m")
+#define COL_RESET resp_puts("\033[0m")
 
 // constants
 const uint8_t EOL_BIN_MAGIC[] = {0xBA, 0xDC, 0x0F, 0xFE, 0xE0, 0x0F, 0xF0, 0x0D}; // BADC0FFEE0DDF00D
 
 // global variables
 i2c_inst_t *i2c_port;
+uint32_t i2c_baud = 100 * 1000; // actual bus clock, as set by i2c_init
 uint8_t board_addr;
-uint8_t uart_buffer[305];
+uint8_t uart_buffer[UART_LINE_MAX + 5];
 uint16_t uart_buffer_index = 0;
+uint8_t line_overflow = 0; // set when an interactive line is too long, and it is discarded
+uint8_t stream_skip = 0; // set when the rest of a streamed line is to be ignored
+uint8_t stream_token_overflow = 0;
 uint8_t input_mode = MODE_ASCII;
 uint8_t m2m_resp = 0;
 uint8_t do_echo = 1;
 uint8_t i2c_addr = 0x00;
 int expected_num = 0;
 uint8_t byte_buffer[256];
-uint8_t byte_buffer_index = 0;
+uint16_t byte_buffer_index = 0; // counts up to 256, so wider than a byte
 uint8_t token_progress = TOKEN_PROGRESS_NONE;
 uint8_t do_repeated_start = 0;
 uint8_t led_hold_off = 0;
 uint8_t led_hold_on = 0;
 uint8_t led_counter = 0;
 uint8_t led_counter_default = 0;
+volatile uint8_t i2c_bus_busy = 0;
+uint8_t sched_next_send = 0; // set by at:, so that the next send is queued rather than executed
+uint64_t sched_deadline = 0;
+uint8_t pattern_buffer[256]; // uploaded compare pattern
+uint16_t pattern_len = 0;
+uint8_t cache_enabled = 0;
+int cache_pending_reg = -1; // register pointer write deferred by send+hold, -1 if none
+uint8_t cache_pending_addr = 0;
+uint8_t script_running = 0;
+char script_result[SCRIPT_RESULT_MAX]; // output of the commands in the running script, each preceded by ';'
+uint16_t script_result_len = 0;
+uint32_t script_step_limit = SCRIPT_DEFAULT_STEPS;
+uint8_t mux_routed = 0; // the current address was set with addr:<mux>,<channel>,<address>
+uint8_t smbus_pec = 0; // append and check the SMBus PEC byte
+uint8_t smbus_op = 0; // block write or block process call waiting for its data
+uint8_t smbus_code = 0;
+
+typedef struct {
+    const char *name;
+    uint8_t name_len;
+    uint8_t prefix;
+    int (*handler)(char *token);
+} cmd_entry_t;
+#define CMD_NONE 0xff
 
 /************* functions ***************/
 
+void stream_char(int c);
+int decode_token(char *token);
+
 void i2c_setup(void) {
     if (I2C_PORT_SELECTED == 0) {
         i2c_port = &i2c0_inst;
     } else {
         i2c_port = &i2c1_inst;
     }
-    i2c_init(i2c_port, 100 * 1000);
+    i2c_baud = i2c_init(i2c_port, config_get()->i2c_baud);
     gpio_set_function(I2C_SDA_PIN, GPIO_FUNC_I2C);
     gpio_set_function(I2C_SCL_PIN, GPIO_FUNC_I2C);
-    gpio_pull_up(I2C_SDA_PIN);
-    gpio_pull_up(I2C_SCL_PIN);
+    if (config_get()->pullups) {
+        gpio_pull_up(I2C_SDA_PIN);
+        gpio_pull_up(I2C_SCL_PIN);
+    } else {
+        gpio_disable_pulls(I2C_SDA_PIN); // the target board has its own pull-up resistors
+        gpio_disable_pulls(I2C_SCL_PIN);
+    }
 }
 
 // returns the following addresses, depending on the state of the ADDR0 and ADDR1 pins:
@@ -96,6 +164,7 @@ uint8_t get_board_address(void) {
     gpio_pull_up(BOARD_ADDR0_PIN);
     gpio_pull_up(BOARD_ADDR1_PIN);
     gpio_pull_up(BOARD_ADDR2_PIN);
+    sleep_us(100); // let the pull-ups charge the pins
     if (gpio_get(BOARD_ADDR0_PIN)) {
         addr |= 0x01;
     }
@@ -124,6 +193,18 @@ int check_ioport_valid(int p) {
     return port_valid;
 }
 
+// the GPIO pins that programs run by vm_run may use, the same as for iowrite and ioread
+uint32_t vm_gpio_mask(void) {
+    uint32_t mask = 0;
+    int p;
+    for (p = 0; p < 32; p++) {
+        if (check_ioport_valid(p)) {
+            mask |= (1u << p);
+        }
+    }
+    return mask;
+}
+
 // print_buf_hex prints a buffer in hex format, up to 304 bytes
 // 000: 00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F : 0123456789ABCDEF
 void
@@ -134,59 +215,63 @@ print_buf_hex(uint8_t *buf, uint16_t len) {
 
     for (i = 0; i < len; i += 16) {
         COL_BLUE;
-        printf("%03d: ", index);
+        resp_printf("%03d: ", index);
         COL_CYAN;
         for (j = 0; j < 16; j++) {
             if (i + j < len) {
-                printf("%02X ", buf[i + j]);
+                resp_hex8(buf[i + j]);
+                resp_putc(' ');
             } else {
-                printf("   ");
+                resp_puts("   ");
             }
         }
         COL_BLUE;
-        printf(": ");
+        resp_puts(": ");
         COL_GREEN;
         for (j = 0; j < 16; j++) {
             if (i + j < len) {
                 c = buf[i + j];
                 if ((c < 32) || (c > 126)) {
-                    printf(".");
+                    resp_putc('.');
                 } else {
-                    printf("%c", c);
+                    resp_putc((char) c);
                 }
             } else {
-                printf(" ");
+                resp_putc(' ');
             }
         }
-        printf("\n");
+        resp_putc('\n');
         index += 16;
     }
     COL_RESET;
 }
 
 // print the buffer as hex bytes, 16 per line, each line ending with '&'.
-// remote side should respond with '&' to continue, or 'X' to abort
+// remote side should respond with '&' to continue, or 'X' to abort.
+// In a script the output is captured and the PC isn't reading, so it's sent without pauses
 void print_buf_m2m_ascii(uint8_t *buf, uint16_t len) {
     uint16_t i;
     char ch;
     for (i = 0; i < len; i++) {
-        printf("%02X ", buf[i]);
-        if ((i % 16) == 15) {
-            putchar(M2M_RESPONSE_CONTINUE_CHAR);
+        resp_hex8(buf[i]);
+        resp_putc(' ');
+        if (((i % 16) == 15) && !script_running) {
+            resp_putc(M2M_RESPONSE_CONTINUE_CHAR);
+            resp_flush(); // the PC must see this line before it can reply
             //wait for a response for up to 1 second
-            ch = getchar_timeout_us(1E6);
+            ch = usbio_getc(1000000);
             if (ch == M2M_RESPONSE_ERR_CHAR) { // PC wishes to abort
-                putchar(M2M_RESPONSE_OK_CHAR);
+                resp_putc(M2M_RESPONSE_OK_CHAR);
                 return;
             }
             if (ch != M2M_RESPONSE_CONTINUE_CHAR) {
                 // unexpected message, or timeout. Abort with error!
-                putchar(M2M_RESPONSE_ERR_CHAR);
+                resp_putc(M2M_RESPONSE_ERR_CHAR);
                 return;
             }
         }
     }
-    putchar(M2M_RESPONSE_OK_CHAR);
+    resp_putc(M2M_RESPONSE_OK_CHAR);
 }
 
 // print the buffer as raw bytes, 64 per line, each line ending with '&'.
@@ -195,23 +280,24 @@ void print_buf_m2m_bin(uint8_t *buf, uint16_t len) {
     uint16_t i;
     char ch;
     for (i = 0; i < len; i++) {
-        putchar(buf[i]);
-        if ((i % 64) == 63) {
-            putchar(M2M_RESPONSE_CONTINUE_CHAR);
+        resp_write(&buf[i], 1);
+        if (((i % 64) == 63) && !script_running) {
+            resp_putc(M2M_RESPONSE_CONTINUE_CHAR);
+            resp_flush(); // the PC must see this line before it can reply
             //wait for a response for up to 1 second
-            ch = getchar_timeout_us(1E6);
+            ch = usbio_getc(1000000);
             if (ch == M2M_RESPONSE_ERR_CHAR) { // PC wishes to abort
-                putchar(M2M_RESPONSE_OK_CHAR);
+                resp_putc(M2M_RESPONSE_OK_CHAR);
                 return;
             }
             if (ch != M2M_RESPONSE_CONTINUE_CHAR) {
                 // unexpected message, or timeout. Abort with error!
-                putchar(M2M_RESPONSE_ERR_CHAR);
+                resp_putc(M2M_RESPONSE_ERR_CHAR);
                 return;
             }
         }
     }
-    putchar(M2M_RESPONSE_OK_CHAR);
+    resp_putc(M2M_RESPONSE_OK_CHAR);
 }
 
 // used only in bitbang mode!
@@ -226,24 +312,33 @@ void pulldown_gpio(uint8_t pin) {
     gpio_set_dir(pin, GPIO_OUT);
     gpio_put(pin, 0);
 }
-// this function will switch into GPIO mode and bitbang the I2C address to see if the ACK is received
-// then it switches back to I2C mode
+// this function will switch the pins into GPIO mode and bitbang the I2C address to see if the ACK is received,
+// then it switches the pins back to I2C mode. The I2C block itself is left configured, so the bus clock is kept.
+// rw is 1 for an SMBus quick read, 0 for a zero-length write (SMBus quick write)
 // returns 1 if ACK received, 0 otherwise
-int bitbang_i2c_addr(unsigned int val) {
+int bitbang_i2c_addr(unsigned int val, int rw) {
     uint8_t ack;
     uint8_t i;
     uint8_t addr = (uint8_t) val;
-    gpio_init(I2C_SDA_PIN);
-    gpio_init(I2C_SCL_PIN);
-    pullup_gpio(I2C_SDA_PIN);
-    pullup_gpio(I2C_SCL_PIN);
+    uint32_t half_us = (500000 + i2c_baud - 1) / i2c_baud; // half of one SCL period, rounded up
+    gpio_set_dir(I2C_SDA_PIN, GPIO_IN);
+    gpio_set_dir(I2C_SCL_PIN, GPIO_IN);
+    gpio_put(I2C_SDA_PIN, 0);
+    gpio_put(I2C_SCL_PIN, 0);
+    gpio_set_function(I2C_SDA_PIN, GPIO_FUNC_SIO);
+    gpio_set_function(I2C_SCL_PIN, GPIO_FUNC_SIO);
+    if ((gpio_get(I2C_SDA_PIN) == 0) || (gpio_get(I2C_SCL_PIN) == 0)) {
+        // another device is holding the bus, don't disturb it
+        gpio_set_function(I2C_SDA_PIN, GPIO_FUNC_I2C);
+        gpio_set_function(I2C_SCL_PIN, GPIO_FUNC_I2C);
+        return 0;
+    }
     // perform the I2C start condition
     pulldown_gpio(I2C_SDA_PIN);
-    sleep_us(5);
+    sleep_us(half_us);
     pulldown_gpio(I2C_SCL_PIN);
-    sleep_us(5);
     addr <<= 1; // left-shift the address by 1 bit
-    addr |= 1; // we want to do an I2C read
+    addr |= (rw ? 1 : 0);
     // send the address
     for (i=0; i<8; i++) {
         if (addr & 0x80) {
@@ -251,32 +346,36 @@ int bitbang_i2c_addr(unsigned int val) {
         } else {
             pulldown_gpio(I2C_SDA_PIN);
         }
-        sleep_us(5);
+        sleep_us(half_us);
         pullup_gpio(I2C_SCL_PIN);
-        sleep_us(5);
+        sleep_us(half_us);
         pulldown_gpio(I2C_SCL_PIN);
-        sleep_us(5);
         addr <<= 1;
     }
     // now read the ACK bit
     pullup_gpio(I2C_SDA_PIN);
-    sleep_us(5);
+    sleep_us(half_us);
     pullup_gpio(I2C_SCL_PIN);
-    sleep_us(5);
+    sleep_us(half_us);
     ack = gpio_get(I2C_SDA_PIN);
     pulldown_gpio(I2C_SCL_PIN);
-    sleep_us(5);
-    // now release the I2C bus
-    pullup_gpio(I2C_SCL_PIN);
-    sleep_us(5);
-    pullup_gpio(I2C_SDA_PIN);
-    sleep_us(5);
+    // stop condition. After a quick read the device may be driving a 0 data bit, in which case SDA
+    // can't rise; each failed attempt clocks out another bit, and by the NACK slot the device lets go
+    for (i = 0; i < 10; i++) {
+        pulldown_gpio(I2C_SDA_PIN);
+        sleep_us(half_us);
+        pullup_gpio(I2C_SCL_PIN);
+        sleep_us(half_us);
+        pullup_gpio(I2C_SDA_PIN);
+        sleep_us(half_us);
+        if (gpio_get(I2C_SDA_PIN)) {
+            break;
+        }
+        pulldown_gpio(I2C_SCL_PIN);
+    }
     // convert back to I2C mode
-    i2c_init(i2c_port, 100 * 1000);
     gpio_set_function(I2C_SDA_PIN, GPIO_FUNC_I2C);
     gpio_set_function(I2C_SCL_PIN, GPIO_FUNC_I2C);
-    gpio_pull_up(I2C_SDA_PIN);
-    gpio_pull_up(I2C_SCL_PIN);
     if (ack==0) { // held low means the device is present
         return 1;
         } else {
@@ -284,25 +383,138 @@ int bitbang_i2c_addr(unsigned int val) {
     }
 }
 
-// scan_uart_input fill the uart_buffer until a newline is received
+// checks whether a device acknowledges its address, using one of the PROBE_* styles
+// returns 1 if ACK received, 0 otherwise
+int probe_i2c_addr(unsigned int val, int style) {
+    uint8_t dummy;
+    if (style == PROBE_READ) {
+        // the I2C block can't do a transfer without data, so this costs one data byte of bus time
+        return (i2c_read_timeout_us(i2c_port, (uint8_t) val, &dummy, 1, false, PROBE_TIMEOUT_US) == 1) ? 1 : 0;
+    }
+    return bitbang_i2c_addr(val, (style == PROBE_QUICK) ? 1 : 0);
+}
+
+// issues a register pointer write that was deferred by send+hold while the cache is enabled
+// returns the i2c_write_blocking result, or 1 if there was nothing pending
+int cache_flush_pending(void) {
+    uint8_t reg;
+    if (cache_pending_reg < 0) {
+        return 1;
+    }
+    reg = (uint8_t) cache_pending_reg;
+    cache_pending_reg = -1;
+    return i2c_write_blocking(i2c_port, cache_pending_addr, &reg, 1, true);
+}
+
+// called when the bytes of a send are complete and the cache is enabled.
+// a send+hold of a single register pointer is deferred, so that a following recv can be answered from the cache,
+// and a register write that matches the shadow value is skipped.
+// returns 1 if the send was handled here, 0 if it should go on the bus
+int cache_send_shortcut(void) {
+    int skip = 0;
+    int flushed = 1;
+    if (do_repeated_start && (expected_num == 1)) {
+        // a pointer write deferred earlier is only checked now, or by the read that follows it
+        flushed = cache_flush_pending();
+        if (flushed != PICO_ERROR_GENERIC) {
+            cache_pending_reg = byte_buffer[0];
+            cache_pending_addr = i2c_addr;
+        }
+        skip = 1;
+    } else if ((!do_repeated_start) && (cache_pending_reg < 0) && (expected_num >= 2) &&
+               regcache_write_matches(i2c_addr, byte_buffer[0], &byte_buffer[1], (uint8_t) (expected_num - 1))) {
+        skip = 1;
+        if (m2m_resp == 0) {
+            COL_BLUE;
+            resp_puts("Write matches cached value, not sent\n");
+            COL_RESET;
+        }
+    }
+    if (!skip) {
+        return 0;
+    }
+    byte_buffer_index = 0;
+    expected_num = 0;
+    do_repeated_start = 0;
+    token_progress = TOKEN_PROGRESS_NONE;
+    if (flushed == PICO_ERROR_GENERIC) {
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_PROT_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_puts("Protocol error sending bytes! Does the I2C device exist?\n");
+            COL_RESET;
+        }
+        return 1;
+    }
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    }
+    return 1;
+}
+
+// chunk callback for the crc commands; ctx points to the running CRC (32 or 16 bit)
+void crc32_chunk(void *ctx, uint32_t offset, const uint8_t *buf, uint16_t len) {
+    uint32_t *crc = (uint32_t *) ctx;
+    *crc = crc32_update(*crc, buf, len);
+}
+void crc16_chunk(void *ctx, uint32_t offset, const uint8_t *buf, uint16_t len) {
+    uint16_t *crc = (uint16_t *) ctx;
+    *crc = crc16_update(*crc, buf, len);
+}
+
+// polls register reg of the current I2C address until (value & mask) == expected, or timeout.
+// returns 1 on match, 0 on timeout, PICO_ERROR_GENERIC if the device doesn't respond.
+// the last value read, number of reads and elapsed time are returned through the pointers
+int wait_reg(uint8_t reg, uint8_t mask, uint8_t expected, uint32_t interval_us, uint32_t timeout_us,
+             uint8_t *value, uint32_t *iterations, uint32_t *elapsed_us) {
+    uint64_t t0 = time_us_64();
+    uint64_t now;
+    int retval;
+    *iterations = 0;
+    while (1) {
+        retval = i2c_write_blocking(i2c_port, i2c_addr, &reg, 1, true);
+        if (retval != PICO_ERROR_GENERIC) {
+            retval = i2c_read_blocking(i2c_port, i2c_addr, value, 1, false);
+        }
+        now = time_us_64();
+        *elapsed_us = (uint32_t) (now - t0);
+        if (retval == PICO_ERROR_GENERIC) {
+            return PICO_ERROR_GENERIC;
+        }
+        (*iterations)++;
+        if ((*value & mask) == expected) {
+            return 1;
+        }
+        if (now - t0 >= timeout_us) {
+            return 0;
+        }
+        usbio_task(); // this can take a while, keep the USB connection serviced
+        if (interval_us > 0) {
+            sleep_us(interval_us);
+        }
+    }
+}
+
+// scan_uart_char adds a received character to the uart_buffer
 // returns number of bytes if a newline is received, 0 otherwise
 int
-scan_uart_input(void) {
-    int c;
+scan_uart_char(int c) {
     uint16_t num_bytes;
-    c = getchar_timeout_us(1000);
-    if (c == PICO_ERROR_TIMEOUT) {
+    // ASCII mode
+    if ((input_mode == MODE_ASCII) && (m2m_resp || !do_echo)) {
+        // nothing is echoed, so there's no line editing to support and tokens are executed as they arrive
+        stream_char(c);
         return 0;
     }
-    // ASCII mode
     if (input_mode == MODE_ASCII) {
         if ((c == 8) || (c==127)) { // backspace pressed
             if (uart_buffer_index > 0) {
                 uart_buffer_index--;
                 if (do_echo) {
-                    putchar(8);
-                    putchar(' ');
-                    putchar(8);
+                    resp_putc(8);
+                    resp_putc(' ');
+                    resp_putc(8);
                 }
             }
             return 0;
@@ -317,9 +529,16 @@ scan_uart_input(void) {
                 // don't send anything
             } else {
                 if (do_echo) {
-                    printf("\n");
+                    resp_putc('\n');
                 }
             }
+            if (line_overflow) {
+                line_overflow = 0;
+                COL_RED;
+                resp_puts("Line too long, ignored\n");
+                COL_RESET;
+                return 0;
+            }
             return num_bytes;
         }
         uart_buffer[uart_buffer_index] = (uint8_t) c;
@@ -327,12 +546,13 @@ scan_uart_input(void) {
             if (m2m_resp) {
                 // don't echo
             } else {
-                putchar(c);
+                resp_putc(c);
             }
         }
         uart_buffer_index++;
-        if (uart_buffer_index >= 300) {
+        if (uart_buffer_index >= UART_LINE_MAX) {
             uart_buffer_index = 0;
+            line_overflow = 1;
         }
         return 0;
     }
@@ -340,6 +560,11 @@ scan_uart_input(void) {
     // we keep reading bytes until we find the magic number
     uart_buffer[uart_buffer_index] = (uint8_t) c;
     uart_buffer_index++;
+    if (uart_buffer_index >= UART_LINE_MAX) {
+        // keep the last 7 bytes, they could be the start of the magic number
+        memmove(uart_buffer, &uart_buffer[uart_buffer_index - 7], 7);
+        uart_buffer_index = 7;
+    }
     if (uart_buffer_index < 8) {
         return 0;
     }
@@ -352,339 +577,2462 @@ scan_uart_input(void) {
     return(0);
 }
 
-int decode_token(char *token) {
+// scan_uart_input fill the uart_buffer until a newline is received
+// all characters that have already arrived are consumed without delay, so that a PC streaming
+// many lines without waiting for each response isn't slowed to one character per main loop pass
+// returns number of bytes if a newline is received, 0 otherwise
+int
+scan_uart_input(void) {
+    int c;
+    int num_bytes;
+    uint32_t timeout_us = 1000;
+    while (1) {
+        c = usbio_getc(timeout_us);
+        if (c == PICO_ERROR_TIMEOUT) {
+            return 0;
+        }
+        num_bytes = scan_uart_char(c);
+        if (num_bytes > 0) {
+            return num_bytes;
+        }
+        timeout_us = 0;
+    }
+}
+
+// abandons any send or upload in progress and reports an error. The rest of the line is skipped,
+// since it would be the data for the abandoned command. detail is appended to msg if not NULL
+int abort_command(const char *msg, const char *detail) {
+    token_progress = TOKEN_PROGRESS_NONE;
+    expected_num = 0;
+    byte_buffer_index = 0;
+    do_repeated_start = 0;
+    sched_next_send = 0;
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_ERR_CHAR);
+    } else {
+        COL_RED;
+        resp_printf("%s%s\n", msg, (detail == NULL) ? "" : detail);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_ERROR;
+}
+
+// reports a malformed command, showing the expected form in interactive mode
+int syntax_error(const char *usage) {
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_ERR_CHAR);
+    } else {
+        COL_RED;
+        resp_printf("Error, expected %s\n", usage);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_device_query(char *token) {
+    resp_printf("easy_adapter_%d\n\r", board_addr);
+    led_hold_off = 1;
+    // reset any state and variables
+    token_progress = TOKEN_PROGRESS_NONE;
+    expected_num = 0;
+    byte_buffer_index = 0;
+    do_repeated_start = 0;
+    cache_pending_reg = -1;
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_bin(char *token) {
+    input_mode = MODE_BIN;
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        resp_puts("Switching to binary mode\n");
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_bytes(char *token) {
+    int32_t n;
+    if (!parse_value(token + 6, &n) || (n < 0)) {
+        expected_num = 0;
+        return syntax_error("bytes:<count>");
+    }
+    expected_num = n;
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Expecting %d bytes\n", expected_num);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_send_hold(char *token) {
+    // perform send, but hold the bus for a later repeated start
+    if (expected_num == 0) {
+        return abort_command("No bytes expected", NULL);
+    }
+    if (expected_num > (int) sizeof(byte_buffer)) {
+        return abort_command("Too many bytes, maximum is 256", NULL);
+    }
+    // consider remainder tokens on the line to be bytes for the send operation
+    byte_buffer_index = 0;
+    token_progress = TOKEN_PROGRESS_SEND;
+    do_repeated_start = 1;
+    return TOKEN_RESULT_OK;
+}
+
+int cmd_tryaddr(char *token) {
     unsigned int val;
-    int ioport, ioval; // used for the iowrite and ioread commands
-    int port_valid;
+    int ioval;
     int retval = 0;
-    if (strcmp(token, "device?") == 0) {
-        printf("easy_adapter_%d\n\r", board_addr);
-        led_hold_off = 1;
-        // reset any state and variables
-        token_progress = TOKEN_PROGRESS_NONE;
-        expected_num = 0;
-        byte_buffer_index = 0;
-        do_repeated_start = 0;
-        return TOKEN_RESULT_LINE_COMPLETE;
+    // tryaddr:<address>[,quick|write0|read]
+    static const char *const styles[] = {"quick", "write0", "read"}; // in PROBE_ order
+    const char *p = token + 8;
+    int32_t addr = -1;
+    ioval = PROBE_QUICK;
+    if (parse_args(&p, &addr, 1) != 1) {
+        addr = -1;
+    } else if (*p != 0) {
+        ioval = parse_word(&p, styles, 3);
+        if (*p != 0) {
+            ioval = -1;
+        }
     }
-    if (strcmp(token, "bin") == 0) {
-        input_mode = MODE_BIN;
+    val = (unsigned int) addr;
+    if ((ioval < 0) || (addr < 0) || (addr > 0x7f)) {
         if(m2m_resp) {
-            putchar(M2M_RESPONSE_OK_CHAR);
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
         } else {
-            printf("Switching to binary mode\n");
+            COL_RED;
+            resp_puts("Error, expected tryaddr:<address>[,quick|write0|read]\n");
+            COL_RESET;
         }
-        return TOKEN_RESULT_LINE_COMPLETE;
+        return TOKEN_RESULT_CMD_COMPLETE;
     }
-    if (strncmp(token, "bytes:", 6) == 0) {
-        sscanf(token, "bytes:%d", &expected_num);
-        if(m2m_resp) {
-            putchar(M2M_RESPONSE_OK_CHAR);
+    cache_flush_pending();
+    retval = probe_i2c_addr(val, ioval);
+    if(m2m_resp) {
+        if (input_mode == MODE_ASCII) {
+            if (retval == 0) {
+                resp_putc(M2M_RESPONSE_PROT_ERR_CHAR);
+            } else {
+                resp_putc(M2M_RESPONSE_OK_CHAR);
+            }
+        } else {
+            // binary mode, todo
+        }
+    } else {
+        if (retval == 0) {
+            COL_RED;
+            resp_puts("Protocol error! Does the I2C device exist?\n");
+            COL_RESET;
         } else {
             COL_BLUE;
-            printf("Expecting %d bytes\n", expected_num);
+            resp_printf("Device found at address 0x%02X\n", val);
             COL_RESET;
         }
-        return TOKEN_RESULT_LINE_COMPLETE;
     }
-    if (strcmp(token, "send+hold") == 0) { // perform send, but hold the bus for a later repeated start
-        if (expected_num == 0) {
-            COL_RED;
-            printf("No bytes expected\n");
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_iowrite(char *token) {
+    int ioport, ioval;
+    int port_valid;
+    const char *p = token + 8;
+    int32_t args[2];
+    ioport = -1;
+    ioval = -1;
+    if ((parse_args(&p, args, 2) == 2) && (*p == 0)) {
+        ioport = args[0];
+        ioval = args[1];
+    }
+    port_valid = check_ioport_valid(ioport);
+    if (port_valid && ((ioval == 0) || (ioval == 1))) {
+        gpio_init(ioport);
+        gpio_set_dir(ioport, GPIO_OUT);
+        gpio_put(ioport, ioval);
+        if(m2m_resp) {
+            resp_putc(M2M_RESPONSE_OK_CHAR);
+        } else {
+            COL_BLUE;
+            resp_printf("Port %d set to output %d\n", ioport, ioval);
             COL_RESET;
-            return TOKEN_RESULT_LINE_COMPLETE;
         }
-        // consider remainder tokens on the line to be bytes for the send operation
-        byte_buffer_index = 0;
-        token_progress = TOKEN_PROGRESS_SEND;
-        do_repeated_start = 1;
-        return TOKEN_RESULT_OK;
-    }
-    if (strncmp(token, "tryaddr:", 8) == 0) {
-        if (strncmp(token, "tryaddr:0x", 10) == 0) {
-            // get i2c_addr in hex
-            sscanf(token, "tryaddr:0x%02X", &val);
+    } else {
+        if(m2m_resp) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
         } else {
-            // get i2c_addr in decimal
-            sscanf(token, "tryaddr:%d", &val);
+            COL_RED;
+            resp_puts("Error, invalid IO port or value\n");
+            COL_RESET;
         }
-        retval = bitbang_i2c_addr(val);
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_ioread(char *token) {
+    int ioport, ioval;
+    int port_valid;
+    int32_t n;
+    ioport = parse_value(token + 7, &n) ? n : -1;
+    port_valid = check_ioport_valid(ioport);
+    if (port_valid) {
+        gpio_init(ioport);
+        gpio_set_dir(ioport, GPIO_IN);
+        gpio_pull_up(ioport); // avoid floating input, so enable pull-up
+        ioval = gpio_get(ioport);
         if(m2m_resp) {
-            if (input_mode == MODE_ASCII) {
-                if (retval == 0) {
-                    putchar(M2M_RESPONSE_PROT_ERR_CHAR);
-                } else {
-                    putchar(M2M_RESPONSE_OK_CHAR);
-                }
+            if (ioval) {
+                resp_putc('1');
             } else {
-                // binary mode, todo
+                resp_putc('0');
             }
+            resp_putc(M2M_RESPONSE_OK_CHAR);
         } else {
-            if (retval == 0) {
-                COL_RED;
-                printf("Protocol error! Does the I2C device exist?\n");
-                COL_RESET;
-            } else {
-                COL_BLUE;
-                printf("Device found at address 0x%02X\n", val);
-                COL_RESET;
-            }
+            COL_BLUE;
+            resp_printf("Port %d read input as %d\n", ioport, ioval);
+            COL_RESET;
+        }
+    } else {
+        if(m2m_resp) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_puts("Error, invalid IO port\n");
+            COL_RESET;
         }
-        return TOKEN_RESULT_LINE_COMPLETE;
     }
-    if (strncmp(token, "iowrite:", 8) == 0) {
-        sscanf(token, "iowrite:%d,%d", &ioport, &ioval);
-        port_valid = check_ioport_valid(ioport);
-        if (port_valid && ((ioval == 0) || (ioval == 1))) {
-            gpio_init(ioport);
-            gpio_set_dir(ioport, GPIO_OUT);
-            gpio_put(ioport, ioval);
-            if(m2m_resp) {
-                putchar(M2M_RESPONSE_OK_CHAR);
-            } else {
-                COL_BLUE;
-                printf("Port %d set to output %d\n", ioport, ioval);
-                COL_RESET;
-            }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_send(char *token) {
+    if (expected_num == 0) {
+        return abort_command("No bytes expected", NULL);
+    }
+    if (expected_num > (int) sizeof(byte_buffer)) {
+        return abort_command("Too many bytes, maximum is 256", NULL);
+    }
+    // consider remainder tokens on the line to be bytes for the send operation
+    byte_buffer_index = 0;
+    token_progress = TOKEN_PROGRESS_SEND;
+    do_repeated_start = 0;
+    return TOKEN_RESULT_OK;
+}
+
+int cmd_recv(char *token) {
+    unsigned int val;
+    int retval = 0;
+    if (expected_num == 0) {
+        return abort_command("No bytes expected", NULL);
+    }
+    if (expected_num > (int) sizeof(byte_buffer)) {
+        return abort_command("Too many bytes, maximum is 256", NULL);
+    }
+    byte_buffer_index = 0;
+    if (cache_pending_reg >= 0) {
+        // send+hold of a register pointer was deferred, so this is a register read
+        val = (unsigned int) cache_pending_reg;
+        if ((cache_pending_addr == i2c_addr) && (expected_num <= REGCACHE_MAX_LEN) &&
+            regcache_read_nv(i2c_addr, (uint8_t) val, byte_buffer, (uint8_t) expected_num)) {
+            cache_pending_reg = -1;
+            retval = expected_num;
         } else {
-            if(m2m_resp) {
-                putchar(M2M_RESPONSE_ERR_CHAR);
-            } else {
-                COL_RED;
-                printf("Error, invalid IO port or value\n");
-                COL_RESET;
+            retval = cache_flush_pending();
+            if (retval != PICO_ERROR_GENERIC) {
+                retval = i2c_read_blocking(i2c_port, i2c_addr, byte_buffer, expected_num, false);
+            }
+            if ((retval != PICO_ERROR_GENERIC) && (expected_num <= REGCACHE_MAX_LEN)) {
+                regcache_store(i2c_addr, (uint8_t) val, byte_buffer, (uint8_t) expected_num, 1);
             }
         }
-        return TOKEN_RESULT_LINE_COMPLETE;
+    } else {
+        retval = i2c_read_blocking(i2c_port, i2c_addr, byte_buffer, expected_num, false);
     }
-    if (strncmp(token, "ioread:", 7) == 0) {
-        sscanf(token, "ioread:%d", &ioport);
-        port_valid = check_ioport_valid(ioport);
-        if (port_valid) {
-            gpio_init(ioport);
-            gpio_set_dir(ioport, GPIO_IN);
-            gpio_pull_up(ioport); // avoid floating input, so enable pull-up
-            ioval = gpio_get(ioport);
-            if(m2m_resp) {
-                if (ioval) {
-                    putchar('1');
-                } else {
-                    putchar('0');
-                }
-                putchar(M2M_RESPONSE_OK_CHAR);
+    if(m2m_resp) {
+        if (input_mode == MODE_ASCII) {
+            if (retval == PICO_ERROR_GENERIC) {
+                resp_putc(M2M_RESPONSE_PROT_ERR_CHAR);
             } else {
-                COL_BLUE;
-                printf("Port %d read input as %d\n", ioport, ioval);
-                COL_RESET;
+                print_buf_m2m_ascii(byte_buffer, expected_num);
             }
         } else {
-            if(m2m_resp) {
-                putchar(M2M_RESPONSE_ERR_CHAR);
-            } else {
-                COL_RED;
-                printf("Error, invalid IO port\n");
-                COL_RESET;
-            }
+            print_buf_m2m_bin(byte_buffer, expected_num);
         }
-        return TOKEN_RESULT_LINE_COMPLETE;
-    }
-    if (strcmp(token, "send") == 0) {
-        if (expected_num == 0) {
+    } else {
+        if (retval == PICO_ERROR_GENERIC) {
             COL_RED;
-            printf("No bytes expected\n");
+            resp_puts("Protocol error reading bytes! Does the I2C device exist?\n");
             COL_RESET;
-            return TOKEN_RESULT_LINE_COMPLETE;
+        } else {
+            print_buf_hex(byte_buffer, expected_num);
         }
-        // consider remainder tokens on the line to be bytes for the send operation
-        byte_buffer_index = 0;
-        token_progress = TOKEN_PROGRESS_SEND;
-        do_repeated_start = 0;
-        return TOKEN_RESULT_OK;
     }
-    if (strcmp(token, "recv") == 0) {
-        if (expected_num == 0) {
-            COL_RED;
-            printf("No bytes expected\n");
-            COL_RESET;
-            return TOKEN_RESULT_LINE_COMPLETE;
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_m2m_resp(char *token) {
+    if (token[9] == '1') {
+        m2m_resp = 1;
+        resp_set_crlf(0); // responses are sent byte-exact
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        m2m_resp = 0;
+        resp_set_crlf(1);
+        resp_puts("M2M response off\n");
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_addr(char *token) {
+    // addr:<address>, in decimal or as 0x hex, or addr:<mux>,<channel>,<address> for a device behind a mux
+    const char *p = token + 5;
+    int32_t args[3];
+    int nargs = parse_args(&p, args, 3);
+    int retval = 1;
+    if (((nargs != 1) && (nargs != 3)) || (*p != 0) || (args[nargs - 1] < 0) || (args[nargs - 1] > 0x7f) ||
+        ((nargs == 3) && ((args[0] < 0) || (args[0] >= MUX_MAX) || (args[1] < 0) || (args[1] > 7)))) {
+        return syntax_error("addr:<address 0-0x7f> or addr:<mux>,<channel>,<address>");
+    }
+    if (nargs == 1) {
+        mux_invalidate_addr((uint8_t) args[0]); // the PC may be about to set a mux itself
+        mux_routed = 0;
+    } else {
+        cache_flush_pending(); // it belongs to the channel that is selected now
+        retval = mux_route((uint8_t) args[0], (uint8_t) args[1]);
+        if (retval == 0) {
+            return syntax_error("addr:<mux>,<channel>,<address>, with the mux registered using mux:");
         }
-        byte_buffer_index = 0;
-        retval = i2c_read_blocking(i2c_port, i2c_addr, byte_buffer, expected_num, false);
-        if(m2m_resp) {
-            if (input_mode == MODE_ASCII) {
-                if (retval == PICO_ERROR_GENERIC) {
-                    putchar(M2M_RESPONSE_PROT_ERR_CHAR);
-                } else {
-                    print_buf_m2m_ascii(byte_buffer, expected_num);
-                }
-            } else {
-                print_buf_m2m_bin(byte_buffer, expected_num);
-            }
-        } else {
-            if (retval == PICO_ERROR_GENERIC) {
-                COL_RED;
-                printf("Protocol error reading bytes! Does the I2C device exist?\n");
-                COL_RESET;
-            } else {
-                print_buf_hex(byte_buffer, expected_num);
-            }
+        if (retval != 1) {
+            // devices on different channels can share an address, and after a failure the channel is unknown
+            regcache_invalidate_all();
         }
-        return TOKEN_RESULT_LINE_COMPLETE;
-    }
-    if (strncmp(token, "m2m_resp:", 9) == 0) {
-        if (token[9] == '1') {
-            m2m_resp = 1;
-            putchar(M2M_RESPONSE_OK_CHAR);
-        } else {
-            m2m_resp = 0;
-            printf("M2M response off\n");
+        if (retval < 0) {
+            mux_routed = 0;
         }
-        return TOKEN_RESULT_LINE_COMPLETE;
     }
-    if (strncmp(token, "addr:0x", 7) == 0) {
-        // get i2c_addr
-        sscanf(token, "addr:0x%02X", &val);
-        i2c_addr = val;
+    if (retval < 0) {
         if(m2m_resp) {
-            putchar(M2M_RESPONSE_OK_CHAR);
+            resp_putc(M2M_RESPONSE_PROT_ERR_CHAR);
         } else {
-            COL_BLUE;
-            printf("I2C address set to 0x%02X\n", i2c_addr);
+            COL_RED;
+            resp_puts("Protocol error! The mux did not respond\n");
             COL_RESET;
         }
-        return TOKEN_RESULT_LINE_COMPLETE;
-    } else if (strncmp(token, "addr:", 5) == 0) {
-        // get i2c_addr in decimal
-        sscanf(token, "addr:%d", &val);
-        i2c_addr = val;
-        if(m2m_resp) {
-            putchar(M2M_RESPONSE_OK_CHAR);
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    i2c_addr = (uint8_t) args[nargs - 1];
+    mux_routed = (nargs == 3);
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        if (nargs == 3) {
+            resp_printf("I2C address set to 0x%02X on mux %d channel %d%s\n", i2c_addr, (int) args[0], (int) args[1],
+                        (retval == 1) ? " (already selected)" : "");
         } else {
-            COL_BLUE;
-            printf("I2C address set to 0x%02X\n", i2c_addr);
-            COL_RESET;
+            resp_printf("I2C address set to 0x%02X\n", i2c_addr);
         }
-        return TOKEN_RESULT_LINE_COMPLETE;
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_cache(char *token) {
+    if (token[6] == '1') {
+        cache_enabled = 1;
+    } else {
+        cache_flush_pending();
+        cache_enabled = 0;
+        regcache_clear();
     }
-    if (strcmp(token, "noecho") == 0) {
-        do_echo = 0;
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
         COL_BLUE;
-        printf("Echo off\n");
+        resp_printf("Register cache %s\n", cache_enabled ? "on" : "off");
         COL_RESET;
-        return 0;
     }
-    if (strcmp(token, "end_tok") == 0) {
-        if (token_progress == TOKEN_PROGRESS_SEND) {
-            // we are still expecting more bytes, on the next line
-            if (m2m_resp) {
-                putchar(M2M_RESPONSE_CONTINUE_CHAR);
-            } else {
-                COL_BLUE;
-                printf("Remaining bytes expected: %d\n", expected_num - byte_buffer_index);
-                COL_RESET;
-            }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_cache_volatility(char *token) {
+    unsigned int val;
+    int ioval;
+    int retval = 0;
+    int32_t reg;
+    // mark a register of the current I2C address as non-volatile (reads may be cached) or volatile
+    ioval = (token[6] == 'n') ? 1 : 0;
+    if (!parse_value(strchr(token, ':') + 1, &reg) || (reg < 0) || (reg > 255)) {
+        return syntax_error("cache_nv:<register> or cache_vol:<register>");
+    }
+    val = (unsigned int) reg;
+    retval = regcache_set_nonvolatile(i2c_addr, (uint8_t) val, ioval);
+    if(m2m_resp) {
+        resp_putc(retval ? M2M_RESPONSE_OK_CHAR : M2M_RESPONSE_ERR_CHAR);
+    } else if (retval) {
+        COL_BLUE;
+        resp_printf("Register 0x%02X at 0x%02X marked %s\n", val & 0xff, i2c_addr, ioval ? "non-volatile" : "volatile");
+        COL_RESET;
+    } else {
+        COL_RED;
+        resp_puts("Error, register cache is full\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_cache_inv(char *token) {
+    int32_t reg;
+    // cache_inv: all registers of the current address, cache_inv:<reg>: one register, cache_inv:all: everything
+    if (strcmp(token, "cache_inv:all") == 0) {
+        regcache_invalidate_all();
+    } else if (strncmp(token, "cache_inv:", 10) == 0) {
+        if (!parse_value(token + 10, &reg) || (reg < 0) || (reg > 255)) {
+            return syntax_error("cache_inv, cache_inv:<register> or cache_inv:all");
         }
-        return TOKEN_RESULT_LINE_COMPLETE;
+        regcache_invalidate(i2c_addr, (uint8_t) reg);
+    } else {
+        regcache_invalidate(i2c_addr, -1);
     }
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_puts("Register cache invalidated\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_noecho(char *token) {
+    do_echo = 0;
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_puts("Echo off\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+static const char *const cfg_fields[] = {"m2m", "echo", "pullup", "id", "baud", "macro", "macro+"};
+#define CFG_FIELD_M2M 0
+#define CFG_FIELD_ECHO 1
+#define CFG_FIELD_PULLUP 2
+#define CFG_FIELD_ID 3
+#define CFG_FIELD_BAUD 4
+#define CFG_FIELD_MACRO 5
+#define CFG_FIELD_MACRO_ADD 6 // appends, since in M2M mode a token (and so one cfg:macro) is limited to TOKEN_MAX
+
+int cmd_cfg_query(char *token) {
+    config_t *cfg = config_get();
+    int id = (cfg->board_id == CONFIG_BOARD_ID_PINS) ? -1 : cfg->board_id;
+    // <m2m>,<echo>,<pullup>,<id>,<baud>,<slots used>,<macro>
+    if (m2m_resp) {
+        // the macro can be longer than a resp_printf line, so it is written separately
+        resp_printf("%d,%d,%d,%d,%lu,%d,", cfg->m2m, cfg->echo, cfg->pullups, id,
+               (unsigned long) cfg->i2c_baud, config_slots_used());
+        resp_puts(cfg->macro);
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Startup settings: M2M response %s, echo %s, pull-ups %s, board ID ", cfg->m2m ? "on" : "off",
+               cfg->echo ? "on" : "off", cfg->pullups ? "on" : "off");
+        if (id < 0) {
+            resp_puts("from pins");
+        } else {
+            resp_printf("%d", id);
+        }
+        resp_printf(", I2C clock %lu Hz\n", (unsigned long) cfg->i2c_baud);
+        resp_puts("Startup macro: ");
+        resp_puts(cfg->macro[0] ? cfg->macro : "(none)");
+        resp_putc('\n');
+        resp_printf("%d of %d flash slots used\n", config_slots_used(), CONFIG_SLOTS);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_cfg(char *token) {
+    // cfg:<field>,<value> changes a startup setting, which is kept once cfg_save is used
+    config_t *cfg = config_get();
+    const char *p = token + 4;
+    int32_t n = 0;
+    int field = parse_word(&p, cfg_fields, sizeof(cfg_fields) / sizeof(cfg_fields[0]));
+    if ((field == CFG_FIELD_MACRO) || (field == CFG_FIELD_MACRO_ADD)) {
+        // the macro is the rest of the token, with ';' between commands
+        n = (field == CFG_FIELD_MACRO) ? 0 : (int32_t) strlen(cfg->macro);
+        if ((n + strlen(p)) >= CONFIG_MACRO_MAX) {
+            return syntax_error("cfg:macro,<commands separated by ;> then cfg:macro+,<more> (up to 235 characters)");
+        }
+        strcpy(&cfg->macro[n], p);
+    } else {
+        if ((field < 0) || !parse_value(p, &n)) {
+            return syntax_error("cfg:<m2m|echo|pullup|id|baud|macro>,<value>");
+        }
+        switch (field) {
+            case CFG_FIELD_M2M:
+            case CFG_FIELD_ECHO:
+            case CFG_FIELD_PULLUP:
+                if ((n < 0) || (n > 1)) {
+                    return syntax_error("cfg:<m2m|echo|pullup>,<0|1>");
+                }
+                if (field == CFG_FIELD_M2M) {
+                    cfg->m2m = (uint8_t) n;
+                } else if (field == CFG_FIELD_ECHO) {
+                    cfg->echo = (uint8_t) n;
+                } else {
+                    cfg->pullups = (uint8_t) n;
+                }
+                break;
+            case CFG_FIELD_ID:
+                if ((n < -1) || (n > 127)) {
+                    return syntax_error("cfg:id,<board ID 0-127, or -1 to use the pins>");
+                }
+                cfg->board_id = (n < 0) ? CONFIG_BOARD_ID_PINS : (uint8_t) n;
+                break;
+            default: // CFG_FIELD_BAUD
+                if ((n < CONFIG_BAUD_MIN) || (n > CONFIG_BAUD_MAX)) {
+                    return syntax_error("cfg:baud,<I2C clock 10000-1000000 Hz>");
+                }
+                cfg->i2c_baud = (uint32_t) n;
+                break;
+        }
+    }
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Startup setting %s changed, use cfg_save to keep it\n", cfg_fields[field]);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_cfg_save(char *token) {
+    int retval;
+    // erasing a sector (once every CONFIG_SLOTS_PER_SECTOR saves) stalls the adapter for tens of milliseconds
+    retval = config_save();
+    if (m2m_resp) {
+        resp_putc(retval ? M2M_RESPONSE_OK_CHAR : M2M_RESPONSE_ERR_CHAR);
+    } else if (retval) {
+        COL_BLUE;
+        resp_puts("Settings saved, they will be used from the next startup\n");
+        COL_RESET;
+    } else {
+        COL_RED;
+        resp_puts("Error, settings could not be written to flash\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_cfg_reset(char *token) {
+    config_reset();
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_puts("Stored settings erased, the defaults will be used from the next startup\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+// a microsecond delay, mainly for use in scripts
+void delay_us_serviced(uint32_t us) {
+    uint64_t end = time_us_64() + us;
+    while (time_us_64() < end) {
+        usbio_task(); // long delays mustn't stall the USB connection
+        sleep_us(((end - time_us_64()) > 1000) ? 1000 : 10);
+    }
+}
+
+int cmd_delay(char *token) {
+    int32_t n;
+    if (!parse_value(token + 6, &n) || (n < 0) || (n > DELAY_MAX_US)) {
+        return syntax_error("delay:<microseconds, up to 10000000>");
+    }
+    delay_us_serviced((uint32_t) n);
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_script_begin(char *token) {
+    // script_begin:<id>[,<name>], the following tokens are stored rather than executed, until script_end
+    const char *p = token + 13;
+    int32_t id;
+    if (!parse_int(&p, &id) || (id < 0) || (id >= SCRIPT_SLOTS) || ((*p != 0) && (*p != ',')) || script_running) {
+        return syntax_error("script_begin:<id 0-7>[,<name>]");
+    }
+    script_record_begin((uint8_t) id, (*p == ',') ? p + 1 : "");
+    // in M2M mode, each line of the script gets a continue response, and script_end completes it
+    if (!m2m_resp) {
+        COL_BLUE;
+        resp_printf("Recording script %d, finish with script_end\n", (int) id);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_OK;
+}
+
+// while a script is being recorded, every token is stored, until script_end
+int script_token(char *token) {
+    int retval;
+    if (strcmp(token, "script_end") == 0) {
+        retval = script_record_end();
+        if (m2m_resp) {
+            resp_putc((retval == 1) ? M2M_RESPONSE_OK_CHAR : M2M_RESPONSE_ERR_CHAR);
+        } else if (retval == 1) {
+            COL_BLUE;
+            resp_puts("Script stored\n");
+            COL_RESET;
+        } else {
+            COL_RED;
+            resp_puts((retval == 0) ? "Error, script is too long, or has unbalanced loops or an invalid parameter\n" :
+                                      "Error, script could not be written to flash\n");
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if (strcmp(token, "end_tok") == 0) {
+        script_record_line_end();
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_CONTINUE_CHAR);
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if (!script_record_token(token)) {
+        script_record_cancel();
+        return abort_command("Script too long, discarded", NULL);
+    }
+    return TOKEN_RESULT_OK;
+}
+
+int cmd_script_query(char *token) {
+    const script_header_t *hdr;
+    uint8_t id;
+    // a space-separated list of <id>,<name>,<length> for each stored script
+    for (id = 0; id < SCRIPT_SLOTS; id++) {
+        hdr = script_get(id);
+        if (hdr == NULL) {
+            continue;
+        }
+        if (m2m_resp) {
+            resp_printf("%d,%s,%lu ", id, hdr->name, (unsigned long) hdr->len);
+        } else {
+            COL_BLUE;
+            resp_printf("Script %d: %s, %lu characters\n", id, hdr->name[0] ? hdr->name : "(no name)", (unsigned long) hdr->len);
+            COL_RESET;
+        }
+    }
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_script_del(char *token) {
+    int32_t id;
+    if (!parse_value(token + 11, &id) || (id < 0) || (id >= SCRIPT_SLOTS)) {
+        return syntax_error("script_del:<id 0-7>");
+    }
+    script_delete((uint8_t) id);
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Script %d deleted\n", (int) id);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+// copies a script token, replacing $0-$7 with the parameters. Returns 0 if the result is too long
+int script_subst(char *out, const char *tok, uint32_t len, char **params, int nparams) {
+    uint32_t i;
+    uint32_t n = 0;
+    uint32_t plen;
+    for (i = 0; i < len; i++) {
+        if ((tok[i] == '$') && (i + 1 < len)) {
+            i++;
+            if ((tok[i] - '0') >= nparams) {
+                return 0;
+            }
+            plen = strlen(params[tok[i] - '0']);
+            if ((n + plen) > TOKEN_MAX) {
+                return 0;
+            }
+            memcpy(&out[n], params[tok[i] - '0'], plen);
+            n += plen;
+        } else {
+            if (n >= TOKEN_MAX) {
+                return 0;
+            }
+            out[n++] = tok[i];
+        }
+    }
+    out[n] = 0;
+    return 1;
+}
+
+// keeps the output of a script command, without its response character. Returns the response character, or 0
+char script_collect(void) {
+    const uint8_t *buf;
+    uint16_t n = resp_captured(&buf);
+    char c = 0;
+    if ((n > 0) && ((buf[n - 1] == M2M_RESPONSE_OK_CHAR) || (buf[n - 1] == M2M_RESPONSE_CONTINUE_CHAR) ||
+                    (buf[n - 1] == M2M_RESPONSE_ERR_CHAR) || (buf[n - 1] == M2M_RESPONSE_PROT_ERR_CHAR) ||
+                    (buf[n - 1] == M2M_RESPONSE_PEC_ERR_CHAR))) {
+        c = (char) buf[--n];
+    }
+    if ((n > 0) && ((script_result_len + n + 1) <= SCRIPT_RESULT_MAX)) {
+        script_result[script_result_len++] = ';';
+        memcpy(&script_result[script_result_len], buf, n);
+        script_result_len += n;
+    }
+    return c;
+}
+
+// runs a stored script, with the command responses collected rather than sent.
+// Returns the number of steps (tokens) run, and sets *status to the response character of the command that failed, or 0.
+// Loops can multiply the work far beyond the script's length, so commands and loop passes are counted against
+// script_step_limit, and *limited is set if the run was stopped there
+uint32_t script_exec(const char *text, uint32_t len, char **params, int nparams, char *status, int *limited) {
+    struct {
+        uint32_t start;
+        uint32_t remaining;
+    } loops[SCRIPT_LOOP_DEPTH];
+    int depth = 0;
+    uint32_t i = 0;
+    uint32_t start;
+    uint32_t steps = 0;
+    uint32_t work = 0;
+    int32_t n;
+    int res;
+    char tok[TOKEN_MAX + 1];
+    char c;
+    int kind;
+    *status = 0;
+    *limited = 0;
+    while (i < len) {
+        if (++work > script_step_limit) {
+            *status = M2M_RESPONSE_ERR_CHAR;
+            *limited = 1;
+            return steps;
+        }
+        if ((work % SCRIPT_USB_SERVICE_STEPS) == 0) {
+            usbio_task(); // a long run mustn't stall the USB connection
+        }
+        if (text[i] == SCRIPT_LINE_END) {
+            i++;
+            decode_token("end_tok");
+            c = script_collect();
+            if ((c == M2M_RESPONSE_ERR_CHAR) || (c == M2M_RESPONSE_PROT_ERR_CHAR) || (c == M2M_RESPONSE_PEC_ERR_CHAR)) {
+                *status = c;
+                return steps;
+            }
+            continue;
+        }
+        start = i;
+        while ((i < len) && (text[i] != ' ') && (text[i] != SCRIPT_LINE_END)) {
+            i++;
+        }
+        // the loop structure comes from the stored text, as script_check saw it, so a parameter
+        // can give a loop count but can't open or close a loop
+        kind = 0;
+        if (((i - start) > 5) && (strncmp(&text[start], "loop:", 5) == 0)) {
+            kind = 1;
+        } else if (((i - start) == 7) && (strncmp(&text[start], "endloop", 7) == 0)) {
+            kind = 2;
+        }
+        if (!script_subst(tok, &text[start], i - start, params, nparams)) {
+            *status = M2M_RESPONSE_ERR_CHAR;
+            return steps;
+        }
+        if ((i < len) && (text[i] == ' ')) {
+            i++;
+        }
+        if (tok[0] == 0) {
+            continue;
+        }
+        // loop:<count> ... endloop, checked when the script was stored; the depth is checked again
+        // in case the flash copy doesn't match what was checked
+        if (kind == 1) {
+            if (!parse_value(tok + 5, &n) || (n < 0) || (depth >= SCRIPT_LOOP_DEPTH)) {
+                *status = M2M_RESPONSE_ERR_CHAR;
+                return steps;
+            }
+            if (n == 0) {
+                // skip to the matching endloop
+                int nest = 1;
+                while ((i < len) && (nest > 0)) {
+                    start = i;
+                    while ((i < len) && (text[i] != ' ') && (text[i] != SCRIPT_LINE_END)) {
+                        i++;
+                    }
+                    if (((i - start) > 5) && (strncmp(&text[start], "loop:", 5) == 0)) {
+                        nest++;
+                    } else if (((i - start) == 7) && (strncmp(&text[start], "endloop", 7) == 0)) {
+                        nest--;
+                    }
+                    i++;
+                }
+                continue;
+            }
+            loops[depth].start = i;
+            loops[depth].remaining = (uint32_t) n;
+            depth++;
+            continue;
+        }
+        if (kind == 2) {
+            if (depth == 0) {
+                *status = M2M_RESPONSE_ERR_CHAR;
+                return steps;
+            }
+            if (--loops[depth - 1].remaining > 0) {
+                i = loops[depth - 1].start;
+            } else {
+                depth--;
+            }
+            continue;
+        }
+        steps++;
+        res = decode_token(tok);
+        c = script_collect();
+        if ((res == TOKEN_RESULT_ERROR) || (c == M2M_RESPONSE_ERR_CHAR) || (c == M2M_RESPONSE_PROT_ERR_CHAR) ||
+            (c == M2M_RESPONSE_PEC_ERR_CHAR)) {
+            *status = (c == 0) ? M2M_RESPONSE_ERR_CHAR : c;
+            return steps;
+        }
+    }
+    if (token_progress != TOKEN_PROGRESS_NONE) {
+        abort_command("Script ended in the middle of a command", NULL);
+        script_collect();
+        *status = M2M_RESPONSE_ERR_CHAR;
+    }
+    return steps;
+}
+
+int cmd_run(char *token) {
+    // run:<id>[,<param 0>,<param 1>,...] runs a stored script, with $0, $1 and so on replaced by the parameters
+    const script_header_t *hdr;
+    char *params[SCRIPT_MAX_PARAMS];
+    int nparams = 0;
+    char *p = token + 4;
+    const char *q = p;
+    int32_t id;
+    uint8_t saved_m2m = m2m_resp;
+    uint8_t saved_mode = input_mode;
+    uint32_t steps;
+    char status;
+    int limited;
+    if (!parse_int(&q, &id) || ((*q != 0) && (*q != ','))) {
+        return syntax_error("run:<id>[,<parameters>]");
+    }
+    p = (char *) q;
+    while ((*p == ',') && (nparams < SCRIPT_MAX_PARAMS)) {
+        *p++ = 0;
+        params[nparams++] = p;
+        while ((*p != 0) && (*p != ',')) {
+            p++;
+        }
+    }
+    hdr = ((id < 0) || (id >= SCRIPT_SLOTS)) ? NULL : script_get((uint8_t) id);
+    if ((hdr == NULL) || (*p != 0) || script_running) {
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_puts((hdr == NULL) ? "Error, no such script\n" : (script_running ? "Error, scripts can't run scripts\n" : "Error, too many parameters\n"));
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    // the commands respond as in M2M mode, so that their results can be checked
+    script_running = 1;
+    script_result_len = 0;
+    m2m_resp = 1;
+    input_mode = MODE_ASCII;
+    resp_set_crlf(0);
+    resp_capture(1);
+    steps = script_exec((const char *) hdr + SCRIPT_HEADER_SIZE, hdr->len, params, nparams, &status, &limited);
+    resp_capture(0);
+    m2m_resp = saved_m2m;
+    input_mode = saved_mode;
+    resp_set_crlf(!m2m_resp);
+    script_running = 0;
+    // <steps run>;<output of each command that returned any>;..., then '.' or the response character of the failing command
+    if (m2m_resp) {
+        resp_printf("%lu", (unsigned long) steps);
+        resp_write((const uint8_t *) script_result, script_result_len);
+        resp_putc((status == 0) ? M2M_RESPONSE_OK_CHAR : status);
+    } else {
+        if (status == 0) {
+            COL_BLUE;
+            resp_printf("Script %d completed, %lu steps run\n", (int) id, (unsigned long) steps);
+        } else {
+            COL_RED;
+            resp_printf("Script %d failed at step %lu%s\n", (int) id, (unsigned long) steps,
+                   limited ? ", step limit reached" :
+                   ((status == M2M_RESPONSE_PROT_ERR_CHAR) ? ", protocol error" :
+                   ((status == M2M_RESPONSE_PEC_ERR_CHAR) ? ", PEC error" : "")));
+        }
+        if (script_result_len > 0) {
+            resp_puts("Output: ");
+            resp_write((const uint8_t *) script_result + 1, script_result_len - 1);
+            resp_putc('\n');
+        }
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_script_limit(char *token) {
+    int32_t n;
+    if (!parse_value(token + 13, &n) || (n <= 0) || (n > SCRIPT_MAX_STEPS)) {
+        return syntax_error("script_limit:<steps, up to 10000000>");
+    }
+    script_step_limit = (uint32_t) n;
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Script step limit set to %d\n", (int) n);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_tag(char *token) {
+    // a tag, echoed back so that the PC can match up pipelined responses
+    if (m2m_resp) {
+        resp_puts(token);
+    }
+    return TOKEN_RESULT_OK;
+}
+
+int cmd_eewrite(char *token) {
+    int ioport, ioval;
+    int retval = 0;
+    // eewrite:<start address>,<address width 1|2>,<page size>, data bytes follow as for send
+    if (expected_num == 0) {
+        return abort_command("No bytes expected", NULL);
+    }
+    const char *p = token + 8;
+    int32_t args[3];
+    if ((parse_args(&p, args, 3) != 3) || (*p != 0) || (args[0] < 0)) {
+        return abort_command("Error, expected eewrite:<start>,<address width>,<page size>", NULL);
+    }
+    retval = args[0];
+    ioport = args[1];
+    ioval = args[2];
+    if (!eeprom_begin(i2c_port, i2c_addr, (uint32_t) retval, (uint8_t) ioport, (uint16_t) ioval, (uint32_t) expected_num)) {
+        return abort_command("Error, invalid EEPROM address width or page size", NULL);
+    }
+    cache_flush_pending();
+    regcache_invalidate(i2c_addr, -1);
+    token_progress = TOKEN_PROGRESS_EEPROM;
+    return TOKEN_RESULT_OK;
+}
+
+int cmd_crc(char *token) {
+    int ioport;
+    int retval = 0;
+    // crc32:<start address>,<address width 0|1|2>,<length> reads the range and returns only its CRC
+    unsigned int start = 0, len = 0;
+    uint32_t crc32 = CRC32_INIT;
+    uint16_t crc16 = CRC16_INIT;
+    uint64_t t0;
+    const char *p = token + 6;
+    int32_t args[3];
+    ioport = -1;
+    if ((parse_args(&p, args, 3) == 3) && (*p == 0) && (args[0] >= 0) && (args[2] >= 0)) {
+        start = (unsigned int) args[0];
+        ioport = args[1];
+        len = (unsigned int) args[2];
+    }
+    if ((ioport < 0) || (ioport > 2) || (len == 0)) {
+        if(m2m_resp) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_printf("Error, expected %.5s:<start>,<address width>,<length>\n", token);
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    cache_flush_pending();
+    t0 = time_us_64();
+    if (token[3] == '3') {
+        retval = mem_read_range(i2c_port, i2c_addr, start, (uint8_t) ioport, len, crc32_chunk, &crc32);
+        crc32 ^= CRC32_XOROUT;
+    } else {
+        retval = mem_read_range(i2c_port, i2c_addr, start, (uint8_t) ioport, len, crc16_chunk, &crc16);
+        crc32 = crc16;
+    }
+    t0 = time_us_64() - t0;
+    if (retval < 0) {
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_PROT_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_puts("Protocol error reading bytes! Does the I2C device exist?\n");
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if (m2m_resp) {
+        resp_printf((token[3] == '3') ? "%08lX" : "%04lX", (unsigned long) crc32);
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf((token[3] == '3') ? "CRC32 of %u bytes: 0x%08lX (%llu us)\n" : "CRC16 of %u bytes: 0x%04lX (%llu us)\n",
+               len, (unsigned long) crc32, (unsigned long long) t0);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_pattern(char *token) {
+    // upload a compare pattern of bytes:N bytes, supplied as for send
+    if ((expected_num == 0) || (expected_num > (int) sizeof(pattern_buffer))) {
+        return abort_command("Error, pattern must be 1 to 256 bytes", NULL);
+    }
+    pattern_len = 0;
+    token_progress = TOKEN_PROGRESS_PATTERN;
+    return TOKEN_RESULT_OK;
+}
+
+int cmd_cmp(char *token) {
+    int ioport, ioval;
+    int retval = 0;
+    // cmp:<start address>,<address width 0|1|2>,<length>,<const|inc|lfsr|buf>[,<param>]
+    unsigned int start = 0, len = 0;
+    static const char *const ptypes[] = {"const", "inc", "lfsr", "buf"};
+    static const uint8_t pattern_ids[] = {MEM_PATTERN_CONST, MEM_PATTERN_INC, MEM_PATTERN_LFSR, MEM_PATTERN_BUF};
+    const char *p = token + 4;
+    int32_t args[3];
+    int32_t param = 0;
+    mem_compare_t cmp;
+    mem_run_t *run;
+    int i, k;
+    ioport = -1;
+    retval = -1;
+    if ((parse_args(&p, args, 3) == 3) && (args[0] >= 0) && (args[2] >= 0)) {
+        retval = parse_word(&p, ptypes, 4);
+        if ((retval >= 0) && (*p != 0) && ((parse_args(&p, &param, 1) != 1) || (*p != 0))) {
+            retval = -1;
+        }
+        if (retval >= 0) {
+            retval = pattern_ids[retval];
+            start = (unsigned int) args[0];
+            ioport = args[1];
+            len = (unsigned int) args[2];
+        }
+    }
+    ioval = param;
+    if ((ioport < 0) || (ioport > 2) || (len == 0) || (retval < 0) ||
+        !mem_compare_init(&cmp, (uint8_t) retval, (uint16_t) ioval, pattern_buffer, pattern_len)) {
+        if(m2m_resp) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_puts("Error, expected cmp:<start>,<address width>,<length>,<const|inc|lfsr|buf>[,<param>]\n");
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    cache_flush_pending();
+    retval = mem_read_range(i2c_port, i2c_addr, start, (uint8_t) ioport, len, mem_compare_chunk, &cmp);
+    if (retval < 0) {
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_PROT_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_puts("Protocol error reading bytes! Does the I2C device exist?\n");
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    // each mismatching run is reported as @<offset>:<length>=<first actual values>, then #<total mismatches>
+    for (i = 0; i < cmp.num_runs; i++) {
+        run = &cmp.runs[i];
+        if (m2m_resp) {
+            resp_printf("@%lX:%lX=", (unsigned long) run->offset, (unsigned long) run->len);
+        } else {
+            COL_RED;
+            resp_printf("0x%06lX: %lu bytes differ: ", (unsigned long) (start + run->offset), (unsigned long) run->len);
+            COL_RESET;
+        }
+        for (k = 0; (k < (int) run->len) && (k < MEM_CMP_MAX_RUN_VALUES); k++) {
+            resp_hex8(run->values[k]);
+            if (!m2m_resp) {
+                resp_putc(' ');
+            }
+        }
+        if (m2m_resp) {
+            resp_putc(' ');
+        } else {
+            resp_putc('\n');
+        }
+    }
+    if (m2m_resp) {
+        resp_printf("#%lX", (unsigned long) cmp.mismatches);
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        if (cmp.runs_dropped) {
+            resp_puts("(more runs not shown)\n");
+        }
+        if (cmp.mismatches == 0) {
+            COL_GREEN;
+        } else {
+            COL_RED;
+        }
+        resp_printf("%lu of %u bytes differ\n", (unsigned long) cmp.mismatches, len);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+// the interrupt-driven engines address a device by its 7-bit address alone, and can't switch mux channels,
+// so they are refused for a device selected with addr:<mux>,<channel>,<address>. Returns 1 if refused
+int refuse_if_routed(void) {
+    if (!mux_routed) {
+        return 0;
+    }
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_ERR_CHAR);
+    } else {
+        COL_RED;
+        resp_puts("Error, not available for a device behind a mux. Use a plain addr: to use the selected channel\n");
+        COL_RESET;
+    }
+    return 1;
+}
+
+int cmd_sample(char *token) {
+    // sample:<job>,<period us>,<length>[,<register>] periodically reads the current I2C address
+    int job = -1, period = 0, len = 0, reg = -1;
+    const char *p = token + 7;
+    int32_t args[4];
+    int nargs = parse_args(&p, args, 4);
+    if (refuse_if_routed()) {
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if ((nargs >= 3) && (*p == 0)) {
+        job = args[0];
+        period = args[1];
+        len = args[2];
+        if (nargs == 4) {
+            reg = args[3];
+        }
+    }
+    if ((job < 0) || (reg > 255) || !sampler_start((uint8_t) job, i2c_addr, reg, (uint8_t) len, (uint32_t) period)) {
+        if(m2m_resp) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_printf("Error, expected sample:<job 0-%d>,<period us>=%d>,<length 1-%d>[,<register>]\n",
+                   SAMPLER_MAX_JOBS - 1, SAMPLER_MIN_PERIOD_US, SAMPLER_MAX_LEN);
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Sampling job %d started\n", job);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_sample_stop(char *token) {
+    int32_t n;
+    if (strcmp(token, "sample_stop:all") == 0) {
+        sampler_stop_all();
+    } else {
+        if (!parse_value(token + 12, &n) || (n < 0)) {
+            return syntax_error("sample_stop:<job> or sample_stop:all");
+        }
+        sampler_stop((uint8_t) n);
+    }
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_puts("Sampling stopped\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_trig(char *token) {
+    int ioport;
+    // trig:<n>,<gpio>,<rise|fall|both>,<length>[,<register>] reads the current I2C address on a GPIO edge
+    static const char *const edge_names[] = {"rise", "fall", "both"};
+    static const uint32_t edge_masks[] = {GPIO_IRQ_EDGE_RISE, GPIO_IRQ_EDGE_FALL, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL};
+    int n = -1, len = 0, reg = -1;
+    const char *p = token + 5;
+    int32_t args[4];
+    int nargs, edge;
+    uint32_t edges = 0;
+    ioport = -1;
+    if (refuse_if_routed()) {
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if (parse_args(&p, args, 2) == 2) {
+        edge = parse_word(&p, edge_names, 3);
+        nargs = parse_args(&p, &args[2], 2);
+        if ((edge >= 0) && (nargs >= 1) && (*p == 0)) {
+            n = args[0];
+            ioport = args[1];
+            edges = edge_masks[edge];
+            len = args[2];
+            if (nargs == 2) {
+                reg = args[3];
+            }
+        }
+    }
+    if ((n < 0) || !check_ioport_valid(ioport) || (reg > 255) ||
+        !trigger_start((uint8_t) n, (uint8_t) ioport, edges, i2c_addr, reg, (uint8_t) len)) {
+        if(m2m_resp) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_printf("Error, expected trig:<n 0-%d>,<gpio>,<rise|fall|both>,<length 1-%d>[,<register>]\n",
+                   SAMPLER_MAX_TRIGGERS - 1, SAMPLER_MAX_LEN);
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Trigger %d attached to port %d\n", n, ioport);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_trig_stop(char *token) {
+    int32_t n;
+    if (strcmp(token, "trig_stop:all") == 0) {
+        trigger_stop_all();
+    } else {
+        if (!parse_value(token + 10, &n) || (n < 0)) {
+            return syntax_error("trig_stop:<n> or trig_stop:all");
+        }
+        trigger_stop((uint8_t) n);
+    }
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_puts("Trigger stopped\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_mux(char *token) {
+    // mux:<n>,<address>[,switch|select] registers an I2C mux, mux:<n>,off removes it
+    static const char *const type_names[] = {"switch", "select"};
+    const char *p = token + 4;
+    int32_t args[2];
+    int nargs = parse_args(&p, args, 2);
+    int type = MUX_TYPE_SWITCH;
+    int ok = 0;
+    if ((nargs == 1) && (strcmp(p, "off") == 0) && (args[0] >= 0) && (args[0] < MUX_MAX)) {
+        mux_unregister((uint8_t) args[0]);
+        ok = 1;
+    } else if ((nargs == 2) && (args[0] >= 0) && (args[0] < MUX_MAX) && (args[1] >= 0) && (args[1] <= 0x7f)) {
+        if (*p != 0) {
+            type = parse_word(&p, type_names, 2);
+        }
+        ok = (type >= 0) && (*p == 0) && mux_register((uint8_t) args[0], (uint8_t) args[1], (uint8_t) type);
+    }
+    if (!ok) {
+        if(m2m_resp) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_printf("Error, expected mux:<n 0-%d>,<address>[,switch|select] or mux:<n>,off\n", MUX_MAX - 1);
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        if (nargs == 1) {
+            resp_printf("Mux %d removed\n", (int) args[0]);
+        } else {
+            resp_printf("Mux %d at address 0x%02X\n", (int) args[0], (int) args[1]);
+        }
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_mux_query(char *token) {
+    uint32_t writes, skipped;
+    uint8_t n, addr, type;
+    int ctrl;
+    mux_stats(&writes, &skipped);
+    if(m2m_resp) {
+        // <writes>,<skipped> then ;<n>,<address>,<type>,<control byte or -1> for each mux
+        resp_printf("%lu,%lu", (unsigned long) writes, (unsigned long) skipped);
+        for (n = 0; n < MUX_MAX; n++) {
+            if (mux_info(n, &addr, &type, &ctrl)) {
+                resp_printf(";%d,%d,%d,%d", n, addr, type, ctrl);
+            }
+        }
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        for (n = 0; n < MUX_MAX; n++) {
+            if (mux_info(n, &addr, &type, &ctrl)) {
+                resp_printf("Mux %d at 0x%02X (%s): ", n, addr, (type == MUX_TYPE_SWITCH) ? "switch" : "select");
+                if (ctrl < 0) {
+                    resp_puts("state unknown\n");
+                } else {
+                    resp_printf("control 0x%02X\n", ctrl);
+                }
+            }
+        }
+        resp_printf("%lu mux writes, %lu skipped\n", (unsigned long) writes, (unsigned long) skipped);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_mux_off(char *token) {
+    int retval;
+    cache_flush_pending();
+    retval = mux_deselect_all();
+    regcache_invalidate_all();
+    if(m2m_resp) {
+        resp_putc((retval < 0) ? M2M_RESPONSE_PROT_ERR_CHAR : M2M_RESPONSE_OK_CHAR);
+    } else if (retval < 0) {
+        COL_RED;
+        resp_puts("Protocol error! A mux did not respond\n");
+        COL_RESET;
+    } else {
+        COL_BLUE;
+        resp_puts("All mux channels deselected\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_alert(char *token) {
+    // alert:<gpio>[,<length>[,<register>]] watches SMBALERT# and reads the alerting device's status
+    int ioport = -1, len = 0, reg = -1;
+    const char *p = token + 6;
+    int32_t args[3];
+    int nargs = parse_args(&p, args, 3);
+    if ((nargs >= 1) && (*p == 0)) {
+        ioport = args[0];
+        if (nargs >= 2) {
+            len = args[1];
+        }
+        if (nargs == 3) {
+            reg = args[2];
+        }
+    }
+    if (!check_ioport_valid(ioport) || (len < 0) || (reg > 255) || ((nargs == 3) && (reg < 0)) ||
+        !alert_start((uint8_t) ioport, reg, (uint8_t) len)) {
+        if(m2m_resp) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_printf("Error, expected alert:<gpio>[,<length 0-%d>[,<register>]]\n", ALERT_MAX_STATUS_LEN);
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Watching port %d for SMBALERT#\n", ioport);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_alert_query(char *token) {
+    uint8_t gpio;
+    uint16_t events, lost;
+    int active = alert_status(&gpio, &events, &lost);
+    if(m2m_resp) {
+        if (active) {
+            resp_printf("%d,%u,%u", gpio, events, lost);
+        } else {
+            resp_putc('-');
+        }
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        if (active) {
+            resp_printf("Watching port %d, %u alerts (%u lost)\n", gpio, events, lost);
+        } else {
+            resp_puts("Not watching for SMBALERT#\n");
+        }
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_alert_stop(char *token) {
+    alert_stop();
+    if(m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_puts("Stopped watching for SMBALERT#\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_waitreg(char *token) {
+    int retval = 0;
+    // waitreg:<register>,<mask>,<value>,<interval us>,<timeout ms>
+    int reg = -1, mask = 0xff, expected = 0, interval = 0, timeout = 0;
+    uint8_t value = 0;
+    uint32_t iterations = 0, elapsed = 0;
+    const char *p = token + 8;
+    int32_t args[5];
+    if ((parse_args(&p, args, 5) == 5) && (*p == 0)) {
+        reg = args[0];
+        mask = args[1];
+        expected = args[2];
+        interval = args[3];
+        timeout = args[4];
+    }
+    if ((reg < 0) || (reg > 255) || (interval < 0) || (timeout <= 0)) {
+        if(m2m_resp) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_puts("Error, expected waitreg:<register>,<mask>,<value>,<interval us>,<timeout ms>\n");
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    cache_flush_pending();
+    retval = wait_reg((uint8_t) reg, (uint8_t) mask, (uint8_t) (expected & mask), (uint32_t) interval,
+                      (uint32_t) timeout * 1000, &value, &iterations, &elapsed);
+    if (retval == PICO_ERROR_GENERIC) {
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_PROT_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_puts("Protocol error reading register! Does the I2C device exist?\n");
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    // the value, read count and elapsed time are returned whether or not the condition was met
+    if (m2m_resp) {
+        resp_printf("%02X,%lu,%lu", value, (unsigned long) iterations, (unsigned long) elapsed);
+        resp_putc(retval ? M2M_RESPONSE_OK_CHAR : M2M_RESPONSE_ERR_CHAR);
+    } else {
+        if (retval) {
+            COL_BLUE;
+            resp_puts("Condition met: ");
+        } else {
+            COL_RED;
+            resp_puts("Timeout: ");
+        }
+        resp_printf("register 0x%02X = 0x%02X after %lu reads, %lu us\n", reg, value,
+               (unsigned long) iterations, (unsigned long) elapsed);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_time_query(char *token) {
+    if (m2m_resp) {
+        resp_printf("%llu", (unsigned long long) time_us_64());
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Adapter time is %llu us\n", (unsigned long long) time_us_64());
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_at(char *token) {
+    // at:<time us> or at:+<delay us> queues the next send to start at that adapter time
+    const char *p = (token[3] == '+') ? &token[4] : &token[3];
+    uint64_t t;
+    if (refuse_if_routed()) {
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if (!parse_u64(&p, &t) || (*p != 0)) {
+        return syntax_error("at:<time us> or at:+<delay us>");
+    }
+    sched_deadline = (token[3] == '+') ? time_us_64() + t : t;
+    sched_next_send = 1;
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Next send will be at %llu us\n", (unsigned long long) sched_deadline);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_sched_query(char *token) {
+    // lists completed scheduled sends as <id>,<start us>,<late us>,<status>
+    sched_result_t r;
+    while (sched_get_result(&r)) {
+        if (m2m_resp) {
+            resp_printf("%u,%llu,%lld,%u ", r.id, (unsigned long long) r.start,
+                   (long long) (r.start - r.deadline), r.status);
+        } else if (r.status == SCHED_STATUS_CANCELLED) {
+            resp_printf("Send %u cancelled\n", r.id);
+        } else {
+            resp_printf("Send %u started at %llu us (%lld us late)%s\n", r.id, (unsigned long long) r.start,
+                   (long long) (r.start - r.deadline), (r.status == SCHED_STATUS_NAK) ? ", protocol error" : "");
+        }
+    }
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("%d sends pending\n", sched_pending());
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_sched_clear(char *token) {
+    sched_clear();
+    sched_next_send = 0;
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_puts("Scheduled sends cancelled\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_wave_cfg(char *token) {
+    // wave_cfg:<register or -1>,<frame bytes>,<rate Hz>,<loop 0|1> plays to the current I2C address
+    int reg = -2, frame = 0, rate = 0, loop = 0;
+    const char *p = token + 9;
+    int32_t args[4];
+    if (refuse_if_routed()) {
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if ((parse_args(&p, args, 4) == 4) && (*p == 0)) {
+        reg = args[0];
+        frame = args[1];
+        rate = args[2];
+        loop = args[3];
+    }
+    if ((reg < -1) || (frame < 0) || (rate < 0) || !wave_config(i2c_addr, reg, (uint8_t) frame, (uint32_t) rate, loop)) {
+        if(m2m_resp) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_printf("Error, expected wave_cfg:<register or -1>,<frame bytes 1-%d>,<rate 1-%d Hz>,<loop 0|1>\n",
+                   WAVE_MAX_FRAME, WAVE_MAX_RATE);
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if(m2m_resp) {
+        resp_printf("%d", wave_capacity());
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Waveform configured, room for %d samples%s\n", wave_capacity(), loop ? "" : " per half");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_wave_fill(char *token) {
+    // bytes:N frame bytes follow, as for send
+    if ((expected_num == 0) || !wave_fill_begin((uint32_t) expected_num)) {
+        return abort_command("Error, no room for the waveform data, or not a whole number of frames", NULL);
+    }
+    byte_buffer_index = 0;
+    token_progress = TOKEN_PROGRESS_WAVE;
+    return TOKEN_RESULT_OK;
+}
+
+int cmd_wave_run(char *token) {
+    int retval = 0;
+    if (strcmp(token, "wave_start") == 0) {
+        // the samples are written behind the register cache's back
+        cache_flush_pending();
+        regcache_invalidate(wave_addr(), -1);
+        retval = wave_start();
+    } else {
+        wave_stop();
+        retval = 1;
+    }
+    if(m2m_resp) {
+        resp_putc(retval ? M2M_RESPONSE_OK_CHAR : M2M_RESPONSE_ERR_CHAR);
+    } else if (retval) {
+        COL_BLUE;
+        resp_printf("Waveform %s\n", wave_playing() ? "playing" : "stopped");
+        COL_RESET;
+    } else {
+        COL_RED;
+        resp_puts("Error, waveform not configured or filled\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_wave_query(char *token) {
+    // <playing>,<samples played>,<underruns>,<errors>,<free halves>
+    if(m2m_resp) {
+        resp_printf("%d,%lu,%lu,%lu,%d", wave_playing(), (unsigned long) wave_samples_played(),
+               (unsigned long) wave_underruns(), (unsigned long) wave_errors(), wave_free_halves());
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Waveform %s, %lu samples played, %lu underruns, %lu protocol errors, %d halves free\n",
+               wave_playing() ? "playing" : "stopped", (unsigned long) wave_samples_played(),
+               (unsigned long) wave_underruns(), (unsigned long) wave_errors(), wave_free_halves());
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_end_tok(char *token) {
     if (token_progress == TOKEN_PROGRESS_SEND) {
-        if (strlen(token) != 2) {
-            COL_RED;
-            printf("Invalid byte: %s\n", token);
-            COL_RESET;
-            return TOKEN_RESULT_LINE_COMPLETE;
-        }
-        sscanf(token, "%02X", &val);
-        byte_buffer[byte_buffer_index] = val;
-        byte_buffer_index++;
-        if (byte_buffer_index == expected_num) {
-            // send the bytes
-            if (m2m_resp==0) {
-                COL_BLUE;
-                printf("Sending %d bytes\n", expected_num);
-                COL_RESET;
-                print_buf_hex(byte_buffer, expected_num);
-            }
-            if (do_repeated_start) {
-                retval = i2c_write_blocking(i2c_port, i2c_addr, byte_buffer, expected_num, true);
+        // we are still expecting more bytes, on the next line
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_CONTINUE_CHAR);
+        } else {
+            COL_BLUE;
+            resp_printf("Remaining bytes expected: %d\n", expected_num - byte_buffer_index);
+            COL_RESET;
+        }
+    } else if (token_progress == TOKEN_PROGRESS_EEPROM) {
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_CONTINUE_CHAR);
+        } else {
+            COL_BLUE;
+            resp_printf("Remaining bytes expected: %d\n", expected_num - (int) eeprom_bytes_received());
+            COL_RESET;
+        }
+    } else if (token_progress == TOKEN_PROGRESS_WAVE) {
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_CONTINUE_CHAR);
+        } else {
+            COL_BLUE;
+            resp_printf("Remaining bytes expected: %d\n", expected_num);
+            COL_RESET;
+        }
+    } else if ((token_progress == TOKEN_PROGRESS_VM) || (token_progress == TOKEN_PROGRESS_SMBUS)) {
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_CONTINUE_CHAR);
+        } else {
+            COL_BLUE;
+            resp_printf("Remaining bytes expected: %d\n", expected_num);
+            COL_RESET;
+        }
+    } else if (token_progress == TOKEN_PROGRESS_PATTERN) {
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_CONTINUE_CHAR);
+        } else {
+            COL_BLUE;
+            resp_printf("Remaining bytes expected: %d\n", expected_num - pattern_len);
+            COL_RESET;
+        }
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+#define SMB_QUICK 0
+#define SMB_SEND 1
+#define SMB_RECV 2
+#define SMB_WRB 3
+#define SMB_RDB 4
+#define SMB_WRW 5
+#define SMB_RDW 6
+#define SMB_CALL 7
+#define SMB_BWR 8
+#define SMB_BRD 9
+#define SMB_BCALL 10
+static const char *const smb_ops[] = {"quick", "send", "recv", "wrb", "rdb", "wrw", "rdw", "call", "bwr", "brd", "bcall"};
+static const uint8_t smb_op_nargs[] = {0, 1, 0, 2, 1, 2, 1, 2, 1, 1, 1}; // command code and value
+
+// reports the result of an SMBus transfer. len is the number of bytes read (into byte_buffer),
+// and word is set for the operations that return a 16-bit value
+void smbus_report(int retval, uint16_t len, int word) {
+    uint16_t i;
+    if (m2m_resp) {
+        if (retval == SMBUS_ERR_PEC) {
+            resp_putc(M2M_RESPONSE_PEC_ERR_CHAR);
+        } else if (retval == SMBUS_ERR_LEN) {
+            resp_putc(M2M_RESPONSE_ERR_CHAR);
+        } else if (retval != SMBUS_OK) {
+            resp_putc(M2M_RESPONSE_PROT_ERR_CHAR);
+        } else {
+            if (word) {
+                resp_printf("%04X", byte_buffer[0] | (byte_buffer[1] << 8)); // sent LSB first
             } else {
-                retval = i2c_write_blocking(i2c_port, i2c_addr, byte_buffer, expected_num, false);
+                for (i = 0; i < len; i++) {
+                    resp_hex8(byte_buffer[i]);
+                }
+            }
+            resp_putc(M2M_RESPONSE_OK_CHAR);
+        }
+        return;
+    }
+    if ((retval == SMBUS_OK) && !word && (len > 0)) {
+        print_buf_hex(byte_buffer, len);
+        return;
+    }
+    if (retval == SMBUS_OK) {
+        COL_BLUE;
+        if (word) {
+            resp_printf("Word: 0x%04X\n", byte_buffer[0] | (byte_buffer[1] << 8));
+        } else {
+            resp_puts("SMBus transfer complete\n");
+        }
+        COL_RESET;
+        return;
+    }
+    COL_RED;
+    if (retval == SMBUS_ERR_PEC) {
+        resp_puts("PEC error, the data from the device is corrupted\n");
+    } else if (retval == SMBUS_ERR_LEN) {
+        resp_puts("Error, the device returned a block count of 0\n");
+    } else {
+        resp_puts("Protocol error! Does the SMBus device exist?\n");
+    }
+    COL_RESET;
+}
+
+// block write and block process call: <command code>, <count>, <data>
+int smbus_block_op(void) {
+    uint8_t buf[SMBUS_BLOCK_MAX + 2];
+    uint16_t len = 0;
+    int retval;
+    buf[0] = smbus_code;
+    buf[1] = (uint8_t) expected_num;
+    memcpy(&buf[2], byte_buffer, expected_num);
+    if (smbus_op == SMB_BWR) {
+        retval = smbus_write(i2c_addr, buf, (uint16_t) (expected_num + 2), smbus_pec);
+    } else {
+        retval = smbus_block_read(i2c_addr, buf, (uint16_t) (expected_num + 2), byte_buffer, &len, smbus_pec);
+    }
+    expected_num = 0;
+    byte_buffer_index = 0;
+    token_progress = TOKEN_PROGRESS_NONE;
+    smbus_report(retval, len, 0);
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_smb(char *token) {
+    // smb:<operation>[,<command code>[,<value>]] performs an SMBus transfer to the current I2C address
+    const char *p = token + 4;
+    int op = parse_word(&p, smb_ops, sizeof(smb_ops) / sizeof(smb_ops[0]));
+    int32_t args[2] = {0, 0};
+    int nargs = 0;
+    uint8_t buf[3];
+    uint16_t len = 0;
+    int retval;
+    if (op >= 0) {
+        nargs = parse_args(&p, args, 2);
+    }
+    if ((op < 0) || (nargs < 0) || (*p != 0) || ((nargs > 0) && ((args[0] < 0) || (args[0] > 255)))) {
+        return syntax_error("smb:<quick|send|recv|wrb|rdb|wrw|rdw|call|bwr|brd|bcall>[,<command code>[,<value>]]");
+    }
+    if ((nargs != smb_op_nargs[op]) || ((nargs == 2) && ((args[1] < 0) || (args[1] > ((op == SMB_WRB) ? 0xff : 0xffff))))) {
+        return syntax_error("smb:<operation>,<command code 0-255>,<value>");
+    }
+    cache_flush_pending();
+    if (cache_enabled) {
+        regcache_invalidate(i2c_addr, -1); // SMBus writes don't go through the cache
+    }
+    mux_invalidate_addr(i2c_addr); // nor does the mux state cache see them
+    buf[0] = (uint8_t) args[0];
+    switch (op) {
+        case SMB_QUICK:
+            // the I2C block can't send an address without data, so this is bit-banged (and has no PEC)
+            retval = probe_i2c_addr(i2c_addr, PROBE_WRITE0) ? SMBUS_OK : SMBUS_ERR_BUS;
+            break;
+        case SMB_SEND:
+            retval = smbus_write(i2c_addr, buf, 1, smbus_pec);
+            break;
+        case SMB_RECV:
+            retval = smbus_read(i2c_addr, NULL, 0, byte_buffer, 1, smbus_pec);
+            len = 1;
+            break;
+        case SMB_WRB:
+        case SMB_WRW:
+            buf[1] = (uint8_t) args[1];
+            buf[2] = (uint8_t) (args[1] >> 8);
+            retval = smbus_write(i2c_addr, buf, (op == SMB_WRB) ? 2 : 3, smbus_pec);
+            break;
+        case SMB_RDB:
+        case SMB_RDW:
+            len = (op == SMB_RDB) ? 1 : 2;
+            retval = smbus_read(i2c_addr, buf, 1, byte_buffer, len, smbus_pec);
+            break;
+        case SMB_CALL:
+            buf[1] = (uint8_t) args[1];
+            buf[2] = (uint8_t) (args[1] >> 8);
+            len = 2;
+            retval = smbus_read(i2c_addr, buf, 3, byte_buffer, len, smbus_pec);
+            break;
+        case SMB_BRD:
+            retval = smbus_block_read(i2c_addr, buf, 1, byte_buffer, &len, smbus_pec);
+            break;
+        default: // SMB_BWR, SMB_BCALL: the data follows, as for send
+            if ((expected_num == 0) || (expected_num > SMBUS_BLOCK_MAX)) {
+                return abort_command("Error, block must be 1 to 255 bytes", NULL);
             }
+            smbus_op = (uint8_t) op;
+            smbus_code = buf[0];
             byte_buffer_index = 0;
-            expected_num = 0;
-            do_repeated_start = 0;
-            token_progress = TOKEN_PROGRESS_NONE;
+            token_progress = TOKEN_PROGRESS_SMBUS;
+            return TOKEN_RESULT_OK;
+    }
+    smbus_report(retval, (retval == SMBUS_OK) ? len : 0, (op == SMB_RDW) || (op == SMB_CALL));
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int data_smbus(uint8_t val) {
+    byte_buffer[byte_buffer_index++] = val;
+    if (byte_buffer_index < expected_num) {
+        return TOKEN_RESULT_OK;
+    }
+    return smbus_block_op();
+}
+
+int cmd_smb_pec(char *token) {
+    smbus_pec = (token[8] == '1') ? 1 : 0;
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("SMBus PEC %s\n", smbus_pec ? "on" : "off");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_vm_load(char *token) {
+    // upload a program of bytes:N bytes (4 per instruction), supplied as for send
+    if (!vm_load_begin((uint32_t) expected_num)) {
+        return abort_command("Error, program must be a multiple of 4 bytes, up to 1024 bytes", NULL);
+    }
+    token_progress = TOKEN_PROGRESS_VM;
+    return TOKEN_RESULT_OK;
+}
+
+int data_vm(uint8_t val) {
+    int bad;
+    expected_num--;
+    if (vm_load_byte(val)) {
+        return TOKEN_RESULT_OK;
+    }
+    expected_num = 0;
+    token_progress = TOKEN_PROGRESS_NONE;
+    bad = vm_verify();
+    if (m2m_resp) {
+        if (bad >= 0) {
+            resp_printf("%d", bad);
+        }
+        resp_putc((bad < 0) ? M2M_RESPONSE_OK_CHAR : M2M_RESPONSE_ERR_CHAR);
+    } else if (bad < 0) {
+        COL_BLUE;
+        resp_puts("Program verified and stored\n");
+        COL_RESET;
+    } else {
+        COL_RED;
+        resp_printf("Error, invalid instruction %d, program discarded\n", bad);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_vm_limit(char *token) {
+    int32_t n;
+    if (!parse_value(token + 9, &n) || (n <= 0) || (n > VM_MAX_STEPS)) {
+        return syntax_error("vm_limit:<steps, up to 10000000>");
+    }
+    vm_set_step_limit((uint32_t) n);
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Program step limit set to %d\n", (int) n);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int cmd_vm_run(char *token) {
+    // vm_run or vm_run:<r0>,<r1>,... runs the uploaded program
+    static const char *const vm_errors[] = {"completed", "step limit reached", "stack overflow or underflow",
+                                            "too much output", "no verified program"};
+    static vm_result_t res; // too big for the stack
+    int32_t args[VM_MAX_ARGS];
+    int nargs = 0;
+    const char *p = token + 6;
+    int i;
+    if (*p == ':') {
+        p++;
+        nargs = parse_args(&p, args, VM_MAX_ARGS);
+        if ((nargs <= 0) || (*p != 0)) {
+            return syntax_error("vm_run or vm_run:<r0>[,<r1>...] (up to 8 values)");
+        }
+    } else if (*p != 0) {
+        return syntax_error("vm_run or vm_run:<r0>[,<r1>...] (up to 8 values)");
+    }
+    cache_flush_pending();
+    vm_run(args, nargs, &res);
+    mux_invalidate_all(); // the program may have written a mux
+    if (cache_enabled) {
+        regcache_invalidate_all(); // the program's writes don't go through the cache
+    }
+    // <status>,<steps>,<pc>,<r0>,<output bytes in hex>
+    if (m2m_resp) {
+        resp_printf("%d,%lu,%u,%ld,", res.status, (unsigned long) res.steps, res.pc, (long) res.r0);
+        for (i = 0; i < res.out_len; i++) {
+            resp_hex8(res.out[i]);
+        }
+        resp_putc((res.status == VM_OK) ? M2M_RESPONSE_OK_CHAR : M2M_RESPONSE_ERR_CHAR);
+    } else {
+        if (res.status == VM_OK) {
+            COL_BLUE;
+        } else {
+            COL_RED;
+        }
+        resp_printf("Program %s after %lu steps, at instruction %u, r0 = %ld\n", vm_errors[res.status],
+               (unsigned long) res.steps, res.pc, (long) res.r0);
+        COL_RESET;
+        if (res.out_len > 0) {
+            print_buf_hex(res.out, res.out_len);
+        }
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int data_wave(uint8_t val) {
+    expected_num--;
+    if (wave_fill_byte((uint8_t) val) == WAVE_FILL_MORE) {
+        return TOKEN_RESULT_OK;
+    }
+    expected_num = 0;
+    token_progress = TOKEN_PROGRESS_NONE;
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_puts("Waveform data stored\n");
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int data_pattern(uint8_t val) {
+    pattern_buffer[pattern_len++] = (uint8_t) val;
+    if (pattern_len < expected_num) {
+        return TOKEN_RESULT_OK;
+    }
+    expected_num = 0;
+    token_progress = TOKEN_PROGRESS_NONE;
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Pattern of %d bytes stored\n", pattern_len);
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int data_eeprom(uint8_t val) {
+    int retval = 0;
+    retval = eeprom_put_byte((uint8_t) val);
+    if (retval == EEPROM_RESULT_MORE) {
+        return TOKEN_RESULT_OK; // continue reading tokens on the eewrite line
+    }
+    expected_num = 0;
+    token_progress = TOKEN_PROGRESS_NONE;
+    if (retval == EEPROM_RESULT_ERROR) {
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_PROT_ERR_CHAR);
+        } else {
+            COL_RED;
+            resp_printf("Protocol error writing EEPROM after %lu bytes!\n", (unsigned long) eeprom_bytes_written());
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if (m2m_resp) {
+        resp_printf("%lu,%llu", (unsigned long) eeprom_bytes_written(), (unsigned long long) eeprom_elapsed_us());
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    } else {
+        COL_BLUE;
+        resp_printf("Wrote %lu bytes in %llu us\n", (unsigned long) eeprom_bytes_written(),
+               (unsigned long long) eeprom_elapsed_us());
+        COL_RESET;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+int data_send(uint8_t val) {
+    int retval = 0;
+    byte_buffer[byte_buffer_index] = val;
+    byte_buffer_index++;
+    if ((byte_buffer_index == expected_num) && sched_next_send) {
+        // the write bypasses the register cache, so the cached values for the device are dropped
+        cache_flush_pending();
+        regcache_invalidate(i2c_addr, -1);
+        mux_invalidate_addr(i2c_addr);
+        retval = sched_add(sched_deadline, i2c_addr, byte_buffer, (uint8_t) expected_num);
+        sched_next_send = 0;
+        byte_buffer_index = 0;
+        expected_num = 0;
+        do_repeated_start = 0;
+        token_progress = TOKEN_PROGRESS_NONE;
+        if (m2m_resp) {
+            if (retval < 0) {
+                resp_putc(M2M_RESPONSE_ERR_CHAR);
+            } else {
+                resp_printf("%d", retval);
+                resp_putc(M2M_RESPONSE_OK_CHAR);
+            }
+        } else if (retval < 0) {
+            COL_RED;
+            resp_printf("Error, schedule queue full, or more than %d bytes\n", SCHED_MAX_LEN);
+            COL_RESET;
+        } else {
+            COL_BLUE;
+            resp_printf("Send %d scheduled for %llu us\n", retval, (unsigned long long) sched_deadline);
+            COL_RESET;
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    if (byte_buffer_index == expected_num) {
+        if (cache_enabled) {
+            if (cache_send_shortcut()) {
+                return TOKEN_RESULT_CMD_COMPLETE;
+            }
+            retval = cache_flush_pending();
             if (retval == PICO_ERROR_GENERIC) {
+                byte_buffer_index = 0;
+                expected_num = 0;
+                do_repeated_start = 0;
+                token_progress = TOKEN_PROGRESS_NONE;
                 if (m2m_resp) {
-                    putchar(M2M_RESPONSE_PROT_ERR_CHAR);
+                    resp_putc(M2M_RESPONSE_PROT_ERR_CHAR);
                 } else {
                     COL_RED;
-                    printf("Protocol error sending bytes! Does the I2C device exist?\n");
+                    resp_puts("Protocol error sending bytes! Does the I2C device exist?\n");
                     COL_RESET;
                 }
-                return TOKEN_RESULT_LINE_COMPLETE;
+                return TOKEN_RESULT_CMD_COMPLETE;
+            }
+        }
+        mux_invalidate_addr(i2c_addr); // a send to a mux changes its channels
+        // send the bytes
+        if (m2m_resp==0) {
+            COL_BLUE;
+            resp_printf("Sending %d bytes\n", expected_num);
+            COL_RESET;
+            print_buf_hex(byte_buffer, expected_num);
+        }
+        if (do_repeated_start) {
+            retval = i2c_write_blocking(i2c_port, i2c_addr, byte_buffer, expected_num, true);
+        } else {
+            retval = i2c_write_blocking(i2c_port, i2c_addr, byte_buffer, expected_num, false);
+        }
+        if (cache_enabled && (expected_num >= 2)) {
+            if (retval == PICO_ERROR_GENERIC) {
+                regcache_store(i2c_addr, byte_buffer[0], NULL, (uint8_t) (expected_num - 1), 0);
+            } else {
+                regcache_store(i2c_addr, byte_buffer[0], &byte_buffer[1], (uint8_t) (expected_num - 1), 0);
             }
+        }
+        byte_buffer_index = 0;
+        expected_num = 0;
+        do_repeated_start = 0;
+        token_progress = TOKEN_PROGRESS_NONE;
+        if (retval == PICO_ERROR_GENERIC) {
             if (m2m_resp) {
-                putchar(M2M_RESPONSE_OK_CHAR);
+                resp_putc(M2M_RESPONSE_PROT_ERR_CHAR);
+            } else {
+                COL_RED;
+                resp_puts("Protocol error sending bytes! Does the I2C device exist?\n");
+                COL_RESET;
+            }
+            return TOKEN_RESULT_CMD_COMPLETE;
+        }
+        if (m2m_resp) {
+            resp_putc(M2M_RESPONSE_OK_CHAR);
+        }
+        return TOKEN_RESULT_CMD_COMPLETE;
+    }
+    return TOKEN_RESULT_OK; // continue reading tokens on the send line
+}
+
+#ifdef PARSE_BENCHMARK
+// checks that a short tag in the middle of a send is echoed as a tag, not taken as a data byte
+int check_tag_in_send(void) {
+    char tag[] = "#1";
+    int res;
+    int ok;
+    token_progress = TOKEN_PROGRESS_SEND;
+    expected_num = 2;
+    byte_buffer_index = 0;
+    do_repeated_start = 0;
+    res = decode_token(tag);
+    ok = (res == TOKEN_RESULT_OK) && (token_progress == TOKEN_PROGRESS_SEND) && (byte_buffer_index == 0);
+    token_progress = TOKEN_PROGRESS_NONE;
+    expected_num = 0;
+    return ok;
+}
+
+int cmd_parse_bench(char *token) {
+    int tag_ok = check_tag_in_send();
+    resp_printf("tag inside send: %s\n", tag_ok ? "echoed" : "FAILED");
+    parse_benchmark();
+    if (m2m_resp) {
+        resp_putc(M2M_RESPONSE_OK_CHAR);
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+#endif
+
+int data_token(char *token) {
+    int val = parse_hex_byte(token);
+    if (val < 0) {
+        return abort_command("Invalid byte: ", token);
+    }
+    switch (token_progress) {
+        case TOKEN_PROGRESS_SEND:
+            return data_send((uint8_t) val);
+        case TOKEN_PROGRESS_EEPROM:
+            return data_eeprom((uint8_t) val);
+        case TOKEN_PROGRESS_PATTERN:
+            return data_pattern((uint8_t) val);
+        case TOKEN_PROGRESS_WAVE:
+            return data_wave((uint8_t) val);
+        case TOKEN_PROGRESS_VM:
+            return data_vm((uint8_t) val);
+        case TOKEN_PROGRESS_SMBUS:
+            return data_smbus((uint8_t) val);
+        default:
+            break;
+    }
+    return TOKEN_RESULT_CMD_COMPLETE;
+}
+
+// command table. Entries must be grouped by first character (they are kept in sorted order),
+// since commands are looked up by their first character, see cmd_table_init
+// prefix is 1 if the name is followed by parameters in the token
+#define CMD(name, prefix, handler) {name, sizeof(name) - 1, prefix, handler}
+const cmd_entry_t cmd_table[] = {
+    CMD("#", 1, cmd_tag),
+    CMD("addr:", 1, cmd_addr),
+    CMD("alert:", 1, cmd_alert),
+    CMD("alert?", 0, cmd_alert_query),
+    CMD("alert_stop", 0, cmd_alert_stop),
+    CMD("at:", 1, cmd_at),
+    CMD("bin", 0, cmd_bin),
+    CMD("bytes:", 1, cmd_bytes),
+    CMD("cache:", 1, cmd_cache),
+    CMD("cache_inv", 1, cmd_cache_inv),
+    CMD("cache_nv:", 1, cmd_cache_volatility),
+    CMD("cache_vol:", 1, cmd_cache_volatility),
+    CMD("cfg:", 1, cmd_cfg),
+    CMD("cfg?", 0, cmd_cfg_query),
+    CMD("cfg_reset", 0, cmd_cfg_reset),
+    CMD("cfg_save", 0, cmd_cfg_save),
+    CMD("cmp:", 1, cmd_cmp),
+    CMD("crc16:", 1, cmd_crc),
+    CMD("crc32:", 1, cmd_crc),
+    CMD("delay:", 1, cmd_delay),
+    CMD("device?", 0, cmd_device_query),
+    CMD("eewrite:", 1, cmd_eewrite),
+    CMD("end_tok", 0, cmd_end_tok),
+    CMD("ioread:", 1, cmd_ioread),
+    CMD("iowrite:", 1, cmd_iowrite),
+    CMD("m2m_resp:", 1, cmd_m2m_resp),
+    CMD("mux:", 1, cmd_mux),
+    CMD("mux?", 0, cmd_mux_query),
+    CMD("mux_off", 0, cmd_mux_off),
+    CMD("noecho", 0, cmd_noecho),
+#ifdef PARSE_BENCHMARK
+    CMD("parse_bench", 0, cmd_parse_bench),
+#endif
+    CMD("pattern", 0, cmd_pattern),
+    CMD("recv", 0, cmd_recv),
+    CMD("run:", 1, cmd_run),
+    CMD("sample:", 1, cmd_sample),
+    CMD("sample_stop:", 1, cmd_sample_stop),
+    CMD("sched?", 0, cmd_sched_query),
+    CMD("sched_clear", 0, cmd_sched_clear),
+    CMD("script?", 0, cmd_script_query),
+    CMD("script_begin:", 1, cmd_script_begin),
+    CMD("script_del:", 1, cmd_script_del),
+    CMD("script_limit:", 1, cmd_script_limit),
+    CMD("send", 0, cmd_send),
+    CMD("send+hold", 0, cmd_send_hold),
+    CMD("smb:", 1, cmd_smb),
+    CMD("smb_pec:", 1, cmd_smb_pec),
+    CMD("time?", 0, cmd_time_query),
+    CMD("trig:", 1, cmd_trig),
+    CMD("trig_stop:", 1, cmd_trig_stop),
+    CMD("tryaddr:", 1, cmd_tryaddr),
+    CMD("vm_limit:", 1, cmd_vm_limit),
+    CMD("vm_load", 0, cmd_vm_load),
+    CMD("vm_run", 1, cmd_vm_run),
+    CMD("waitreg:", 1, cmd_waitreg),
+    CMD("wave?", 0, cmd_wave_query),
+    CMD("wave_cfg:", 1, cmd_wave_cfg),
+    CMD("wave_fill", 0, cmd_wave_fill),
+    CMD("wave_start", 0, cmd_wave_run),
+    CMD("wave_stop", 0, cmd_wave_run),
+};
+#define CMD_TABLE_LEN (sizeof(cmd_table) / sizeof(cmd_table[0]))
+uint8_t cmd_first[128]; // index of the first cmd_table entry for each starting character, or CMD_NONE
+
+void cmd_table_init(void) {
+    int i;
+    memset(cmd_first, CMD_NONE, sizeof(cmd_first));
+    for (i = CMD_TABLE_LEN - 1; i >= 0; i--) {
+        cmd_first[(uint8_t) cmd_table[i].name[0]] = (uint8_t) i;
+    }
+}
+
+const cmd_entry_t *find_command(const char *token) {
+    uint8_t c = (uint8_t) token[0];
+    uint8_t i;
+    if ((c >= sizeof(cmd_first)) || (cmd_first[c] == CMD_NONE)) {
+        return NULL;
+    }
+    for (i = cmd_first[c]; (i < CMD_TABLE_LEN) && ((uint8_t) cmd_table[i].name[0] == c); i++) {
+        if (cmd_table[i].prefix) {
+            if (strncmp(token, cmd_table[i].name, cmd_table[i].name_len) == 0) {
+                return &cmd_table[i];
             }
-            return TOKEN_RESULT_LINE_COMPLETE;
+        } else if (strcmp(token, cmd_table[i].name) == 0) {
+            return &cmd_table[i];
         }
-        return TOKEN_RESULT_OK; // continue reading tokens on the send line
+    }
+    return NULL;
+}
+
+int decode_token(char *token) {
+    const cmd_entry_t *cmd;
+    if (script_recording()) {
+        return script_token(token);
+    }
+    // while a command is collecting data, a two-character token can only be a data byte or a tag
+    // such as #1, since no command name is that short, so skip the command lookup for the bytes
+    if ((token_progress != TOKEN_PROGRESS_NONE) && (token[0] != '#') && (token[0] != 0) && (token[1] != 0) &&
+        (token[2] == 0)) {
+        return data_token(token);
+    }
+    cmd = find_command(token);
+    if (cmd != NULL) {
+        return cmd->handler(token);
+    }
+    if (token_progress != TOKEN_PROGRESS_NONE) {
+        return data_token(token); // reports the invalid byte
     }
     // done
     if (m2m_resp) {
-        putchar(M2M_RESPONSE_ERR_CHAR);
-        return TOKEN_RESULT_LINE_COMPLETE;
+        resp_putc(M2M_RESPONSE_ERR_CHAR);
+        return TOKEN_RESULT_CMD_COMPLETE;
     } else {
         COL_RED;
-        printf("Unknown command: %s\n", token);
+        resp_printf("Unknown command: %s\n", token);
         COL_RESET;
-        return TOKEN_RESULT_LINE_COMPLETE;
+        return TOKEN_RESULT_CMD_COMPLETE;
     }
 }
 
-// if in ASCII mode, parse each space-separated token
-int process_line(uint8_t *buf, uint16_t len) {
+// tells the PC that the adapter is ready for commands. The message has none of the M2M response characters
+void send_ready(void) {
+    char msg[40];
+    int n = snprintf(msg, sizeof(msg), "easy_adapter_%d ready\r\n", board_addr);
+    usbio_send_ready((const uint8_t *) msg, (uint32_t) n);
+}
+
+// runs one command token, keeping the interrupt-driven engines off the bus meanwhile
+int exec_token(char *token) {
     int res;
-    char token[20];
-    uint16_t i = 0;
-    uint16_t j = 0;
+    i2c_bus_busy = 1;
+    while (wave_bus_active()) {
+        tight_loop_contents(); // let a waveform sample that is on the wire finish
+    }
+    res = decode_token(token);
+    i2c_bus_busy = 0;
+    resp_flush(); // one write for the whole response
+    return res;
+}
+
+// if in ASCII mode, parse each space-separated token. Every command on the line is executed in turn,
+// each giving its own response, unless a command fails in a way that makes the rest of the line meaningless.
+// tokens are terminated in place, so nothing is copied
+int process_line(uint8_t *buf, uint16_t len) {
+    int res = TOKEN_RESULT_CMD_COMPLETE;
+    uint16_t i;
+    uint16_t start = 0;
     if (len == 0) {
         return TOKEN_RESULT_ERROR;
     }
-    while (i < len) {
+    for (i = 0; i < len; i++) {
         if (buf[i] == ' ') {
-            token[j] = 0;
-            //printf("token: %s\n", token);
-            res = decode_token(token);
-            if (res == TOKEN_RESULT_LINE_COMPLETE) {
-                return TOKEN_RESULT_LINE_COMPLETE;
+            buf[i] = 0;
+            if (i > start) {
+                res = exec_token((char *) &buf[start]);
+                if (res == TOKEN_RESULT_ERROR) {
+                    return TOKEN_RESULT_ERROR;
+                }
             }
-            j = 0;
-        } else {
-            token[j] = buf[i];
-            j++;
+            start = i + 1;
+        }
+    }
+    exec_token("end_tok");
+    return res;
+}
+
+// called at whitespace or end of line in streamed input, runs the token collected so far
+void stream_token_end(void) {
+    if (uart_buffer_index == 0) {
+        return;
+    }
+    if (stream_token_overflow) {
+        stream_token_overflow = 0;
+        if (!stream_skip) {
+            abort_command("Token too long", NULL);
+        }
+        stream_skip = 1;
+    } else if (!stream_skip) {
+        uart_buffer[uart_buffer_index] = 0;
+        if (exec_token((char *) uart_buffer) == TOKEN_RESULT_ERROR) {
+            stream_skip = 1;
+        }
+    }
+    uart_buffer_index = 0;
+}
+
+// streamed input: each token is executed as soon as it is complete, so a line (such as a long send)
+// can be any length; only the current token needs to be held
+void stream_char(int c) {
+    if (c == 13) {
+        stream_token_end();
+        if (!stream_skip) {
+            exec_token("end_tok");
+        }
+        stream_skip = 0;
+        return;
+    }
+    if ((c == ' ') || (c == '\t') || (c == '\n')) {
+        stream_token_end();
+        return;
+    }
+    if ((c == 8) || (c == 127)) {
+        if (uart_buffer_index > 0) {
+            uart_buffer_index--;
+        }
+        return;
+    }
+    if (uart_buffer_index < TOKEN_MAX) {
+        uart_buffer[uart_buffer_index++] = (uint8_t) c;
+    } else {
+        stream_token_overflow = 1;
+    }
+}
+
+// applies the stored settings that take effect at startup, then runs the startup macro
+void config_apply(void) {
+    config_t *cfg = config_get();
+    uint16_t len;
+    uint16_t i;
+    m2m_resp = cfg->m2m;
+    resp_set_crlf(!m2m_resp);
+    do_echo = cfg->echo;
+    if (cfg->macro[0] == 0) {
+        return;
+    }
+    // the macro is run as a line of commands; its responses are discarded if the PC isn't connected yet
+    len = (uint16_t) strlen(cfg->macro);
+    memcpy(uart_buffer, cfg->macro, len);
+    for (i = 0; i < len; i++) {
+        if (uart_buffer[i] == ';') {
+            uart_buffer[i] = ' ';
         }
-        i++;
     }
-    res = decode_token("end_tok");
+    uart_buffer[len++] = ' ';
+    process_line(uart_buffer, len);
+    resp_flush();
 }
 
 int
 main(void)
 {
     int numbytes;
-    stdio_init_all();
-    sleep_ms(100);
-    board_addr = get_board_address();
-    sleep_ms(3000);
+    // nothing waits for the PC here; USB enumerates in the background while the main loop runs,
+    // and the ready message is sent when the PC opens the port
+    usbio_init();
+    config_load(); // stored settings, or the defaults
+    if (config_get()->board_id == CONFIG_BOARD_ID_PINS) {
+        board_addr = get_board_address();
+    } else {
+        board_addr = config_get()->board_id;
+    }
     led_setup(); // initialize LED pin to be an output
     i2c_setup(); // configures the I2C pins accordingly
+    sched_init(); // claims a hardware alarm for scheduled sends
+    wave_init(); // claims a DMA channel for waveform playback
+    cmd_table_init();
+    vm_init(vm_gpio_mask());
+    config_apply();
 
     while (1) {
+        usbio_task();
+        if (usbio_connect_event()) {
+            send_ready();
+        }
         numbytes = scan_uart_input();
         if (numbytes > 0) {
             process_line(uart_buffer, numbytes);
         }
+        if (alert_pending()) {
+            // SMBALERT# arrived while a command had the bus
+            i2c_bus_busy = 1;
+            while (wave_bus_active()) {
+                tight_loop_contents();
+            }
+            alert_service();
+            i2c_bus_busy = 0;
+        }
+        sampler_drain(m2m_resp);
+        resp_flush(); // echoed input, and any sample frames and alert events
 
         if (led_hold_off) {
             if (led_counter <= 0) {
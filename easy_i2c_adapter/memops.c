@@ -0,0 +1,174 @@
+/****************************************
+ * memops.c
+ * rev 1.0 Oct 2026
+ * sequential reads of memory devices (EEPROM, FRAM etc.)
+ * **************************************/
+
+#include "memops.h"
+#include "buslock.h"
+#include "pico/stdlib.h"
+
+#define I2C_FIFO_DEPTH 16
+
+uint8_t
+mem_dev_addr(uint8_t devaddr, uint32_t start, uint8_t awidth)
+{
+    if (awidth == 0) {
+        return devaddr;
+    }
+    return devaddr | ((start >> (8 * awidth)) & 0x07);
+}
+
+// an arbitrarily long read as one I2C transfer. i2c_read_blocking needs the whole result in a buffer,
+// so the data commands are issued directly, keeping the RX FIFO from overflowing
+static int
+mem_read_stream(i2c_inst_t *i2c, uint8_t dev, uint32_t len, mem_chunk_cb_t cb, void *ctx)
+{
+    i2c_hw_t *hw = i2c_get_hw(i2c);
+    uint8_t chunk[MEM_CHUNK_SIZE];
+    uint16_t n = 0;
+    uint32_t issued = 0;
+    uint32_t received = 0;
+    uint32_t cmd;
+    uint64_t deadline;
+
+    hw->enable = 0;
+    hw->tar = dev;
+    hw->enable = 1;
+    deadline = time_us_64() + MEM_BYTE_TIMEOUT_US;
+    while (received < len) {
+        while ((issued < len) && ((issued - received) < I2C_FIFO_DEPTH)) {
+            cmd = I2C_IC_DATA_CMD_CMD_BITS;
+            if ((issued == 0) && i2c->restart_on_next) {
+                cmd |= I2C_IC_DATA_CMD_RESTART_BITS;
+            }
+            if (issued == len - 1) {
+                cmd |= I2C_IC_DATA_CMD_STOP_BITS;
+            }
+            hw->data_cmd = cmd;
+            issued++;
+        }
+        if (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) {
+            (void) hw->clr_tx_abrt;
+            deadline = time_us_64() + MEM_BYTE_TIMEOUT_US;
+            while (!(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS)) {
+                if (time_us_64() > deadline) {
+                    i2c_abort_transfer(i2c);
+                    return PICO_ERROR_GENERIC;
+                }
+            }
+            (void) hw->clr_stop_det;
+            i2c->restart_on_next = false;
+            return PICO_ERROR_GENERIC;
+        }
+        while (hw->rxflr > 0) {
+            chunk[n++] = (uint8_t) hw->data_cmd;
+            received++;
+            if (n == MEM_CHUNK_SIZE) {
+                cb(ctx, received - n, chunk, n);
+                n = 0;
+            }
+            deadline = time_us_64() + MEM_BYTE_TIMEOUT_US;
+        }
+        if (time_us_64() > deadline) {
+            // the device is holding the bus, or stopped responding. The reads still queued have
+            // no stop, so the transfer is aborted to release the bus
+            i2c_abort_transfer(i2c);
+            return PICO_ERROR_TIMEOUT;
+        }
+    }
+    if (n > 0) {
+        cb(ctx, received - n, chunk, n);
+    }
+    i2c->restart_on_next = false;
+    return (int) len;
+}
+
+int
+mem_read_range(i2c_inst_t *i2c, uint8_t devaddr, uint32_t start, uint8_t awidth, uint32_t len,
+               mem_chunk_cb_t cb, void *ctx)
+{
+    uint8_t ptr[2];
+    uint8_t dev = mem_dev_addr(devaddr, start, awidth);
+    int retval;
+    if (len == 0) {
+        return 0;
+    }
+    if (awidth == 2) {
+        ptr[0] = (start >> 8) & 0xff;
+        ptr[1] = start & 0xff;
+    } else {
+        ptr[0] = start & 0xff;
+    }
+    if (awidth > 0) {
+        retval = i2c_write_blocking(i2c, dev, ptr, awidth, true);
+        if (retval == PICO_ERROR_GENERIC) {
+            return PICO_ERROR_GENERIC;
+        }
+    }
+    return mem_read_stream(i2c, dev, len, cb, ctx);
+}
+
+int
+mem_compare_init(mem_compare_t *c, uint8_t type, uint16_t param, const uint8_t *buf, uint16_t buf_len)
+{
+    if ((type > MEM_PATTERN_BUF) || ((type == MEM_PATTERN_BUF) && (buf_len == 0))) {
+        return 0;
+    }
+    c->type = type;
+    c->param = (uint8_t) param;
+    c->lfsr = (param == 0) ? 0xACE1 : param; // an all-zero LFSR never changes
+    c->buf = buf;
+    c->buf_len = buf_len;
+    c->mismatches = 0;
+    c->num_runs = 0;
+    c->runs_dropped = 0;
+    return 1;
+}
+
+static uint8_t
+mem_pattern_byte(mem_compare_t *c, uint32_t offset)
+{
+    switch (c->type) {
+        case MEM_PATTERN_INC:
+            return (uint8_t) (c->param + offset);
+        case MEM_PATTERN_LFSR:
+            c->lfsr = (c->lfsr >> 1) ^ ((c->lfsr & 1) ? 0xB400 : 0);
+            return (uint8_t) c->lfsr;
+        case MEM_PATTERN_BUF:
+            return c->buf[offset % c->buf_len];
+        default:
+            return c->param;
+    }
+}
+
+void
+mem_compare_chunk(void *ctx, uint32_t offset, const uint8_t *buf, uint16_t len)
+{
+    mem_compare_t *c = (mem_compare_t *) ctx;
+    mem_run_t *run;
+    uint16_t i;
+    uint32_t pos;
+    for (i = 0; i < len; i++) {
+        pos = offset + i;
+        if (buf[i] == mem_pattern_byte(c, pos)) {
+            continue;
+        }
+        c->mismatches++;
+        run = (c->num_runs > 0) ? &c->runs[c->num_runs - 1] : NULL;
+        if ((run != NULL) && (run->offset + run->len == pos)) {
+            // extends the previous run
+            if (run->len < MEM_CMP_MAX_RUN_VALUES) {
+                run->values[run->len] = buf[i];
+            }
+            run->len++;
+        } else if (c->num_runs < MEM_CMP_MAX_RUNS) {
+            run = &c->runs[c->num_runs++];
+            run->offset = pos;
+            run->len = 1;
+            run->values[0] = buf[i];
+        } else {
+            c->runs_dropped = 1;
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef _MEMOPS_HEADER_FILE_
+#define _MEMOPS_HEADER_FILE_
+
+/***********************************
+ * memops.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+#include "hardware/i2c.h"
+
+#define MEM_CHUNK_SIZE 64
+#define MEM_BYTE_TIMEOUT_US 10000
+
+// called for each chunk of bytes as it arrives; offset is relative to the start of the range
+typedef void (*mem_chunk_cb_t)(void *ctx, uint32_t offset, const uint8_t *buf, uint16_t len);
+
+// patterns for mem_compare
+#define MEM_PATTERN_CONST 0 // every byte is param
+#define MEM_PATTERN_INC 1 // param, param+1, param+2...
+#define MEM_PATTERN_LFSR 2 // low byte of a 16-bit Galois LFSR (taps 0xB400) seeded with param, stepped before each byte
+#define MEM_PATTERN_BUF 3 // an uploaded buffer, repeated
+#define MEM_CMP_MAX_RUNS 16
+#define MEM_CMP_MAX_RUN_VALUES 16
+
+// a run of consecutive mismatching bytes; only the first few actual values are kept
+typedef struct mem_run_s {
+    uint32_t offset;
+    uint32_t len;
+    uint8_t values[MEM_CMP_MAX_RUN_VALUES];
+} mem_run_t;
+
+typedef struct mem_compare_s {
+    uint8_t type;
+    uint8_t param;
+    uint16_t lfsr;
+    const uint8_t *buf;
+    uint16_t buf_len;
+    uint32_t mismatches;
+    uint8_t num_runs;
+    uint8_t runs_dropped; // set if there were more runs than MEM_CMP_MAX_RUNS
+    mem_run_t runs[MEM_CMP_MAX_RUNS];
+} mem_compare_t;
+
+// returns the device address to use for memory address start; memory address bits
+// beyond the address bytes go into the low bits of the device address (e.g. 24C04..24C16)
+uint8_t mem_dev_addr(uint8_t devaddr, uint32_t start, uint8_t awidth);
+// sets the memory address pointer (awidth 0 means no pointer write) and reads len bytes
+// sequentially, handing them to cb in chunks. Returns len, or PICO_ERROR_GENERIC/PICO_ERROR_TIMEOUT
+int mem_read_range(i2c_inst_t *i2c, uint8_t devaddr, uint32_t start, uint8_t awidth, uint32_t len,
+                   mem_chunk_cb_t cb, void *ctx);
+
+// prepares a compare; returns 0 if the pattern is invalid
+int mem_compare_init(mem_compare_t *c, uint8_t type, uint16_t param, const uint8_t *buf, uint16_t buf_len);
+// chunk callback for mem_read_range, ctx is a mem_compare_t
+void mem_compare_chunk(void *ctx, uint32_t offset, const uint8_t *buf, uint16_t len);
+
+#endif // _MEMOPS_HEADER_FILE_
@@ -0,0 +1,149 @@
+/****************************************
+ * mux.c
+ * rev 1.0 Oct 2026
+ * I2C mux/switch channel routing, with the channel state cached
+ * **************************************/
+
+#include "mux.h"
+#include "buslock.h"
+#include "pico/stdlib.h"
+
+typedef struct mux_s {
+    uint8_t active;
+    uint8_t addr;
+    uint8_t type;
+    uint8_t known; // ctrl holds what the mux is set to
+    uint8_t ctrl;
+} mux_t;
+
+static mux_t muxes[MUX_MAX];
+static uint32_t mux_writes = 0;
+static uint32_t mux_skipped = 0;
+
+// writes the control byte unless the mux is known to hold it already.
+// Returns 1 if skipped, 2 if written, -1 on failure (the state is then unknown)
+static int
+mux_set(mux_t *m, uint8_t ctrl)
+{
+    if (m->known && (m->ctrl == ctrl)) {
+        mux_skipped++;
+        return 1;
+    }
+    mux_writes++;
+    if (i2c_write_timeout_us(i2c_port, m->addr, &ctrl, 1, false, MUX_I2C_TIMEOUT_US) < 0) {
+        m->known = 0;
+        return -1;
+    }
+    m->ctrl = ctrl;
+    m->known = 1;
+    return 2;
+}
+
+int
+mux_register(uint8_t n, uint8_t addr, uint8_t type)
+{
+    if ((n >= MUX_MAX) || (addr > 0x7f) || (type > MUX_TYPE_SELECT)) {
+        return 0;
+    }
+    muxes[n].active = 1;
+    muxes[n].addr = addr;
+    muxes[n].type = type;
+    muxes[n].known = 0;
+    return 1;
+}
+
+void
+mux_unregister(uint8_t n)
+{
+    if (n < MUX_MAX) {
+        muxes[n].active = 0;
+    }
+}
+
+int
+mux_route(uint8_t n, uint8_t channel)
+{
+    mux_t *m;
+    uint8_t ctrl;
+    int i;
+    int retval;
+    int wrote = 0;
+    if ((n >= MUX_MAX) || !muxes[n].active) {
+        return 0;
+    }
+    m = &muxes[n];
+    if (channel >= ((m->type == MUX_TYPE_SWITCH) ? 8 : 4)) {
+        return 0;
+    }
+    ctrl = (m->type == MUX_TYPE_SWITCH) ? (uint8_t) (1 << channel) : (uint8_t) (MUX_SELECT_ENABLE | channel);
+    // the others first, so that two channels are never connected together
+    for (i = 0; i < MUX_MAX; i++) {
+        if (muxes[i].active && (i != n)) {
+            retval = mux_set(&muxes[i], 0);
+            if (retval < 0) {
+                return -1;
+            }
+            wrote |= (retval == 2);
+        }
+    }
+    retval = mux_set(m, ctrl);
+    if (retval < 0) {
+        return -1;
+    }
+    return (wrote || (retval == 2)) ? 2 : 1;
+}
+
+int
+mux_deselect_all(void)
+{
+    int i;
+    int retval = 1;
+    for (i = 0; i < MUX_MAX; i++) {
+        if (muxes[i].active) {
+            muxes[i].known = 0; // always written, in case the fixture was changed
+            if (mux_set(&muxes[i], 0) < 0) {
+                retval = -1;
+            }
+        }
+    }
+    return retval;
+}
+
+void
+mux_invalidate_addr(uint8_t addr)
+{
+    int i;
+    for (i = 0; i < MUX_MAX; i++) {
+        if (muxes[i].active && (muxes[i].addr == addr)) {
+            muxes[i].known = 0;
+        }
+    }
+}
+
+void
+mux_invalidate_all(void)
+{
+    int i;
+    for (i = 0; i < MUX_MAX; i++) {
+        muxes[i].known = 0;
+    }
+}
+
+int
+mux_info(uint8_t n, uint8_t *addr, uint8_t *type, int *ctrl)
+{
+    if ((n >= MUX_MAX) || !muxes[n].active) {
+        return 0;
+    }
+    *addr = muxes[n].addr;
+    *type = muxes[n].type;
+    *ctrl = muxes[n].known ? muxes[n].ctrl : -1;
+    return 1;
+}
+
+void
+mux_stats(uint32_t *writes, uint32_t *skipped)
+{
+    *writes = mux_writes;
+    *skipped = mux_skipped;
+}
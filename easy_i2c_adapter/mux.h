@@ -0,0 +1,39 @@
+#ifndef _MUX_HEADER_FILE_
+#define _MUX_HEADER_FILE_
+
+/***********************************
+ * mux.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+#define MUX_MAX 4
+#define MUX_TYPE_SWITCH 0 // TCA9548A, PCA9548A/9546A/9545A/9543A: the control byte is a mask of enabled channels
+#define MUX_TYPE_SELECT 1 // PCA9544A/9542A: the control byte is 0x04 (enable) plus the channel number
+#define MUX_SELECT_ENABLE 0x04
+#define MUX_I2C_TIMEOUT_US 2000
+
+// the control byte last written to each mux is remembered, so that selecting the channel
+// that is already selected costs no bus traffic
+
+// registers mux n at addr, with 8 channels for MUX_TYPE_SWITCH and 4 for MUX_TYPE_SELECT.
+// Its state is unknown until the first route. Returns 1 on success
+int mux_register(uint8_t n, uint8_t addr, uint8_t type);
+void mux_unregister(uint8_t n);
+// selects channel on mux n, and deselects every other registered mux (their downstream devices
+// could share addresses). Returns 1 if nothing had to be written, 2 if a mux was written,
+// 0 for an invalid mux or channel, or -1 if a mux didn't acknowledge
+int mux_route(uint8_t n, uint8_t channel);
+// deselects all channels of every registered mux. Returns 1 on success, -1 if a mux didn't acknowledge
+int mux_deselect_all(void);
+// forgets the state of any mux at addr, called when the PC addresses a mux directly
+void mux_invalidate_addr(uint8_t addr);
+// forgets the state of every mux, after something that may have written any address (a program run)
+void mux_invalidate_all(void);
+// returns 0 if mux n isn't registered. *ctrl is the last control byte written, or -1 if unknown
+int mux_info(uint8_t n, uint8_t *addr, uint8_t *type, int *ctrl);
+// the number of control writes made, and skipped because the channel was already selected
+void mux_stats(uint32_t *writes, uint32_t *skipped);
+
+#endif // _MUX_HEADER_FILE_
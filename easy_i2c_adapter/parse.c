@@ -0,0 +1,238 @@
+/****************************************
+ * parse.c
+ * rev 1.0 Oct 2026
+ * number parsing for command tokens, without sscanf
+ * **************************************/
+
+#include <string.h>
+#include "parse.h"
+
+#define DIGIT_NONE 0xFF
+
+// value of each character as a hex digit, or DIGIT_NONE. Decimal digits are the entries below 10
+static const uint8_t digit_value[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+int
+parse_hex_byte(const char *s) {
+    uint8_t hi, lo;
+    hi = digit_value[(uint8_t) s[0]];
+    if (hi == DIGIT_NONE) {
+        return -1;
+    }
+    lo = digit_value[(uint8_t) s[1]];
+    if ((lo == DIGIT_NONE) || (s[2] != 0)) {
+        return -1;
+    }
+    return (hi << 4) | lo;
+}
+
+// converts four hex digit characters at once, using SWAR operations on a 32-bit word
+// (each byte is one character). Returns 0 if any of the four is not a hex digit
+static int
+hex4_swar(const char *s, uint32_t *val) {
+    uint32_t w, lower, digit, letter, v;
+    memcpy(&w, s, 4); // first character in the low byte
+    if (w & 0x80808080) {
+        return 0;
+    }
+    // a byte has its top bit set after adding (0x80 - lo) if it is >= lo,
+    // and after adding (0x7F - hi) if it is > hi. No byte can carry into the next
+    digit = (w + 0x50505050) & ~(w + 0x46464646) & 0x80808080; // '0'..'9'
+    lower = w | 0x20202020; // 'A'..'F' become 'a'..'f', digits are unchanged
+    letter = (lower + 0x1F1F1F1F) & ~(lower + 0x19191919) & 0x80808080; // 'a'..'f'
+    if ((digit | letter) != 0x80808080) {
+        return 0;
+    }
+    v = (w & 0x0F0F0F0F) + (letter >> 7) * 9; // one nibble per byte
+    v = ((v << 4) | (v >> 8)) & 0x00FF00FF; // pairs of nibbles into bytes 0 and 2
+    *val = ((v & 0xFF) << 8) | (v >> 16);
+    return 1;
+}
+
+int
+parse_u64(const char **s, uint64_t *val) {
+    const char *p = *s;
+    uint64_t v = 0;
+    uint32_t four;
+    uint8_t d;
+    int n, len;
+    if ((p[0] == '0') && ((p[1] == 'x') || (p[1] == 'X'))) {
+        p += 2;
+        // find the length of the field first, so the four-digit conversion never reads past its end
+        for (len = 0; (p[len] != 0) && (p[len] != ','); len++) {
+        }
+        if ((len == 0) || (len > 16)) {
+            return 0;
+        }
+        n = 0;
+        while ((len - n) >= 4) {
+            if (!hex4_swar(&p[n], &four)) {
+                break;
+            }
+            v = (v << 16) | four;
+            n += 4;
+        }
+        while (n < len) {
+            d = digit_value[(uint8_t) p[n]];
+            if (d == DIGIT_NONE) {
+                break;
+            }
+            v = (v << 4) | d;
+            n++;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        *s = &p[n];
+        *val = v;
+        return 1;
+    }
+    for (n = 0; ; n++) {
+        d = digit_value[(uint8_t) p[n]];
+        if (d >= 10) {
+            break;
+        }
+        if (v > (UINT64_MAX - d) / 10) {
+            return 0; // overflow
+        }
+        v = v * 10 + d;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    *s = &p[n];
+    *val = v;
+    return 1;
+}
+
+int
+parse_int(const char **s, int32_t *val) {
+    const char *p = *s;
+    uint64_t v;
+    int neg = 0;
+    if (*p == '-') {
+        neg = 1;
+        p++;
+    }
+    if (!parse_u64(&p, &v)) {
+        return 0;
+    }
+    if (v > (neg ? 0x80000000ULL : 0x7FFFFFFFULL)) {
+        return 0;
+    }
+    *val = neg ? (int32_t) (0 - v) : (int32_t) v;
+    *s = p;
+    return 1;
+}
+
+int
+parse_value(const char *s, int32_t *val) {
+    return parse_int(&s, val) && (*s == 0);
+}
+
+int
+parse_args(const char **s, int32_t *vals, int max) {
+    const char *p = *s;
+    int n = 0;
+    while ((n < max) && (*p != 0)) {
+        if ((*p != '-') && (digit_value[(uint8_t) *p] >= 10)) {
+            break; // not a number, left for the caller
+        }
+        if (!parse_int(&p, &vals[n])) {
+            return -1;
+        }
+        n++;
+        if (*p == ',') {
+            p++;
+            if ((*p == 0) || (*p == ',')) {
+                return -1; // empty field
+            }
+        } else if (*p != 0) {
+            return -1; // junk after the number
+        }
+    }
+    *s = p;
+    return n;
+}
+
+int
+parse_word(const char **s, const char *const *words, int count) {
+    const char *p = *s;
+    int len, i;
+    for (len = 0; (p[len] != 0) && (p[len] != ','); len++) {
+    }
+    for (i = 0; i < count; i++) {
+        if ((strncmp(p, words[i], len) == 0) && (words[i][len] == 0)) {
+            p += len;
+            if (*p == ',') {
+                p++;
+            }
+            *s = p;
+            return i;
+        }
+    }
+    return -1;
+}
+
+#ifdef PARSE_BENCHMARK
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "resp.h"
+
+// compares the time taken by sscanf and by these parsers, for a data byte and for a command's arguments
+void
+parse_benchmark(void) {
+    static const char *bytes[] = {"00", "7f", "A5", "ff"};
+    volatile unsigned int sink = 0;
+    unsigned int val, a, b, c;
+    int32_t args[3];
+    const char *p;
+    uint32_t t0, t_scanf, t_parse;
+    int i;
+    t0 = time_us_32();
+    for (i = 0; i < 10000; i++) {
+        sscanf(bytes[i & 3], "%02X", &val);
+        sink += val;
+    }
+    t_scanf = time_us_32() - t0;
+    t0 = time_us_32();
+    for (i = 0; i < 10000; i++) {
+        sink += (unsigned int) parse_hex_byte(bytes[i & 3]);
+    }
+    t_parse = time_us_32() - t0;
+    resp_printf("data byte: sscanf %lu ns, parse_hex_byte %lu ns\n", (unsigned long) t_scanf / 10,
+           (unsigned long) t_parse / 10);
+    t0 = time_us_32();
+    for (i = 0; i < 1000; i++) {
+        sscanf("0x1F40,2,65536", "%i,%i,%i", (int *) &a, (int *) &b, (int *) &c);
+        sink += a + b + c;
+    }
+    t_scanf = time_us_32() - t0;
+    t0 = time_us_32();
+    for (i = 0; i < 1000; i++) {
+        p = "0x1F40,2,65536";
+        parse_args(&p, args, 3);
+        sink += (unsigned int) (args[0] + args[1] + args[2]);
+    }
+    t_parse = time_us_32() - t0;
+    resp_printf("arguments: sscanf %lu ns, parse_args %lu ns\n", (unsigned long) t_scanf,
+                (unsigned long) t_parse);
+}
+#endif
@@ -0,0 +1,32 @@
+#ifndef _PARSE_HEADER_FILE_
+#define _PARSE_HEADER_FILE_
+
+/***********************************
+ * parse.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+// parses a data byte token, which must be exactly two hex digits. Returns 0-255, or -1 if malformed
+int parse_hex_byte(const char *s);
+// parses a number (decimal, or hex with a 0x prefix) at *s, advancing *s past it.
+// Returns 1 on success, 0 if there are no digits or the value doesn't fit in 64 bits
+int parse_u64(const char **s, uint64_t *val);
+// as parse_u64, with an optional leading '-', limited to the int32_t range
+int parse_int(const char **s, int32_t *val);
+// parses a field that must be exactly one integer. Returns 1 on success
+int parse_value(const char *s, int32_t *val);
+// parses up to max comma-separated integers from *s, advancing *s to the first field not parsed.
+// Stops early at the end of the string or at a field that doesn't start with a digit or '-'.
+// Returns the number of values parsed, or -1 if a field is malformed or out of range
+int parse_args(const char **s, int32_t *vals, int max);
+// matches the field at *s (ending at a comma or the end of the string) against a list of words,
+// advancing *s past it and any following comma. Returns the index of the word, or -1
+int parse_word(const char **s, const char *const *words, int count);
+
+#ifdef PARSE_BENCHMARK
+void parse_benchmark(void);
+#endif
+
+#endif // _PARSE_HEADER_FILE_
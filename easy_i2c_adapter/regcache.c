@@ -0,0 +1,166 @@
+/****************************************
+ * regcache.c
+ * rev 1.0 Oct 2026
+ * **************************************/
+
+#include <string.h>
+#include "regcache.h"
+
+typedef struct regcache_entry_s {
+    uint8_t addr;
+    uint8_t reg;
+    uint8_t len;
+    uint8_t flags;
+    uint8_t val[REGCACHE_MAX_LEN];
+} regcache_entry_t;
+
+// open-addressed table; an entry with in_use set keeps its slot even when invalidated,
+// so that probe chains are never broken
+static regcache_entry_t cache_table[REGCACHE_SIZE];
+static uint8_t cache_in_use[REGCACHE_SIZE];
+
+static unsigned int
+regcache_hash(uint8_t addr, uint8_t reg)
+{
+    return (((unsigned int) addr * 31) + reg) & (REGCACHE_SIZE - 1);
+}
+
+// returns the entry for (addr, reg), optionally allocating it. NULL if not found or table full
+static regcache_entry_t *
+regcache_find(uint8_t addr, uint8_t reg, int create)
+{
+    unsigned int i;
+    unsigned int h = regcache_hash(addr, reg);
+    for (i = 0; i < REGCACHE_SIZE; i++) {
+        if (!cache_in_use[h]) {
+            if (!create) {
+                return NULL;
+            }
+            cache_in_use[h] = 1;
+            cache_table[h].addr = addr;
+            cache_table[h].reg = reg;
+            cache_table[h].len = 0;
+            cache_table[h].flags = 0;
+            return &cache_table[h];
+        }
+        if ((cache_table[h].addr == addr) && (cache_table[h].reg == reg)) {
+            return &cache_table[h];
+        }
+        h = (h + 1) & (REGCACHE_SIZE - 1);
+    }
+    return NULL;
+}
+
+void
+regcache_clear(void)
+{
+    memset(cache_in_use, 0, sizeof(cache_in_use));
+}
+
+void
+regcache_invalidate(uint8_t addr, int reg)
+{
+    unsigned int i;
+    for (i = 0; i < REGCACHE_SIZE; i++) {
+        if (cache_in_use[i] && (cache_table[i].addr == addr)) {
+            if ((reg < 0) || (cache_table[i].reg == reg)) {
+                cache_table[i].flags &= ~REGCACHE_FLAG_VALID;
+            }
+        }
+    }
+}
+
+void
+regcache_invalidate_all(void)
+{
+    unsigned int i;
+    for (i = 0; i < REGCACHE_SIZE; i++) {
+        cache_table[i].flags &= ~REGCACHE_FLAG_VALID;
+    }
+}
+
+int
+regcache_set_nonvolatile(uint8_t addr, uint8_t reg, int nv)
+{
+    regcache_entry_t *e = regcache_find(addr, reg, 1);
+    if (e == NULL) {
+        return 0;
+    }
+    if (nv) {
+        e->flags |= REGCACHE_FLAG_NONVOLATILE;
+    } else {
+        e->flags &= ~REGCACHE_FLAG_NONVOLATILE;
+    }
+    return 1;
+}
+
+int
+regcache_write_matches(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len)
+{
+    regcache_entry_t *e = regcache_find(addr, reg, 0);
+    if ((e == NULL) || ((e->flags & REGCACHE_FLAG_VALID) == 0)) {
+        return 0;
+    }
+    if ((e->len != len) || (memcmp(e->val, buf, len) != 0)) {
+        return 0;
+    }
+    return 1;
+}
+
+int
+regcache_read_nv(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len)
+{
+    regcache_entry_t *e = regcache_find(addr, reg, 0);
+    if ((e == NULL) || (e->flags != (REGCACHE_FLAG_VALID | REGCACHE_FLAG_NONVOLATILE))) {
+        return 0;
+    }
+    if (e->len != len) {
+        return 0;
+    }
+    memcpy(buf, e->val, len);
+    return 1;
+}
+
+// drops every value of addr that shares a register with a write of len bytes at reg: the registers
+// the write auto-incremented into, and multi-byte values starting below reg that cover it
+static void
+regcache_invalidate_overlap(uint8_t addr, uint8_t reg, uint8_t len)
+{
+    unsigned int i;
+    unsigned int start, end;
+    for (i = 0; i < REGCACHE_SIZE; i++) {
+        if (cache_in_use[i] && (cache_table[i].addr == addr) && (cache_table[i].flags & REGCACHE_FLAG_VALID)) {
+            start = cache_table[i].reg;
+            end = start + cache_table[i].len;
+            if ((start < (unsigned int) reg + len) && (end > reg)) {
+                cache_table[i].flags &= ~REGCACHE_FLAG_VALID;
+            }
+        }
+    }
+}
+
+// written values are always shadowed; read values are only kept for non-volatile registers.
+// a write drops any cached value it overlaps, since many devices auto-increment the register number.
+// buf is NULL for a failed write, in which case the register is dropped too
+void
+regcache_store(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len, int from_read)
+{
+    regcache_entry_t *e;
+    if (!from_read) {
+        regcache_invalidate_overlap(addr, reg, (len > 0) ? len : 1);
+    }
+    if ((buf == NULL) || (len == 0) || (len > REGCACHE_MAX_LEN)) {
+        regcache_invalidate(addr, reg);
+        return;
+    }
+    e = regcache_find(addr, reg, from_read ? 0 : 1);
+    if (e == NULL) {
+        return;
+    }
+    if (from_read && ((e->flags & REGCACHE_FLAG_NONVOLATILE) == 0)) {
+        return;
+    }
+    memcpy(e->val, buf, len);
+    e->len = len;
+    e->flags |= REGCACHE_FLAG_VALID;
+}
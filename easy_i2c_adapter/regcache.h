@@ -0,0 +1,26 @@
+#ifndef _REGCACHE_HEADER_FILE_
+#define _REGCACHE_HEADER_FILE_
+
+/***********************************
+ * regcache.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+// shadow register cache, keyed on (I2C address, register)
+// each entry holds the last value (1..4 bytes) written to, or read from, a register
+#define REGCACHE_SIZE 128
+#define REGCACHE_MAX_LEN 4
+#define REGCACHE_FLAG_VALID 0x01
+#define REGCACHE_FLAG_NONVOLATILE 0x02
+
+void regcache_clear(void); // forget everything, including non-volatile marks
+void regcache_invalidate(uint8_t addr, int reg); // forget values for addr, reg -1 means all registers
+void regcache_invalidate_all(void); // forget all values, keeping the non-volatile marks
+int regcache_set_nonvolatile(uint8_t addr, uint8_t reg, int nv); // returns 0 if the table is full
+int regcache_write_matches(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len); // returns 1 if a write can be skipped
+int regcache_read_nv(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len); // returns 1 if buf was filled from the cache
+void regcache_store(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len, int from_read);
+
+#endif // _REGCACHE_HEADER_FILE_
@@ -0,0 +1,112 @@
+/****************************************
+ * resp.c
+ * rev 1.0 Oct 2026
+ * response builder, output is collected into a buffer and sent to the USB CDC interface in one write
+ * **************************************/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "usbio.h"
+#include "resp.h"
+
+static const char hex_digits[] = "0123456789ABCDEF";
+static uint8_t tx_buf[RESP_BUF_SIZE];
+static uint16_t tx_len = 0;
+static uint8_t crlf = 1;
+static uint8_t capturing = 0;
+
+void
+resp_set_crlf(int on) {
+    crlf = on ? 1 : 0;
+}
+
+void
+resp_flush(void) {
+    if ((tx_len == 0) || capturing) {
+        return;
+    }
+    usbio_write(tx_buf, tx_len);
+    usbio_flush();
+    tx_len = 0;
+}
+
+void
+resp_capture(int on) {
+    if (on && !capturing) {
+        resp_flush();
+    }
+    capturing = on ? 1 : 0;
+}
+
+uint16_t
+resp_captured(const uint8_t **buf) {
+    uint16_t n = tx_len;
+    *buf = tx_buf;
+    tx_len = 0;
+    return n;
+}
+
+void
+resp_write(const uint8_t *buf, uint16_t len) {
+    uint16_t n;
+    while (len > 0) {
+        if (tx_len == RESP_BUF_SIZE) {
+            if (capturing) {
+                return;
+            }
+            resp_flush();
+        }
+        n = RESP_BUF_SIZE - tx_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(&tx_buf[tx_len], buf, n);
+        tx_len += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+void
+resp_putc(char c) {
+    if (tx_len >= (RESP_BUF_SIZE - 1)) {
+        if (capturing) {
+            return;
+        }
+        resp_flush(); // leaves room for CR LF
+    }
+    if ((c == '\n') && crlf) {
+        tx_buf[tx_len++] = '\r';
+    }
+    tx_buf[tx_len++] = (uint8_t) c;
+}
+
+void
+resp_puts(const char *s) {
+    while (*s) {
+        resp_putc(*s++);
+    }
+}
+
+void
+resp_hex8(uint8_t v) {
+    if (tx_len >= (RESP_BUF_SIZE - 1)) {
+        if (capturing) {
+            return;
+        }
+        resp_flush();
+    }
+    tx_buf[tx_len++] = hex_digits[v >> 4];
+    tx_buf[tx_len++] = hex_digits[v & 0x0f];
+}
+
+void
+resp_printf(const char *fmt, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    resp_puts(line);
+}
@@ -0,0 +1,30 @@
+#ifndef _RESP_HEADER_FILE_
+#define _RESP_HEADER_FILE_
+
+/***********************************
+ * resp.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+#define RESP_BUF_SIZE 512
+
+// text output. '\n' is sent as CR LF if enabled by resp_set_crlf (for interactive terminals)
+void resp_putc(char c);
+void resp_puts(const char *s);
+void resp_printf(const char *fmt, ...);
+// a byte as two upper-case hex digits
+void resp_hex8(uint8_t v);
+// raw bytes, not translated
+void resp_write(const uint8_t *buf, uint16_t len);
+void resp_set_crlf(int on);
+// sends everything buffered so far
+void resp_flush(void);
+// while capture is on, output is kept in the buffer instead of being sent, and anything
+// that doesn't fit is dropped. Turning it on sends whatever was already buffered
+void resp_capture(int on);
+// returns the output captured since the last call, and empties the buffer. The data is valid until the next output
+uint16_t resp_captured(const uint8_t **buf);
+
+#endif // _RESP_HEADER_FILE_
@@ -0,0 +1,328 @@
+/****************************************
+ * sampler.c
+ * rev 1.0 Oct 2026
+ * periodic I2C sampling, driven by repeating timers
+ * **************************************/
+
+#include <stdio.h>
+#include "sampler.h"
+#include "buslock.h"
+#include "crc.h"
+#include "resp.h"
+#include "usbio.h"
+#include "gpioirq.h"
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+typedef struct sampler_job_s {
+    uint8_t active;
+    uint8_t addr;
+    int reg;
+    uint8_t len;
+    uint16_t seq;
+    uint16_t overruns;
+    repeating_timer_t timer;
+} sampler_job_t;
+
+typedef struct sample_s {
+    uint8_t job;
+    uint8_t len;
+    uint16_t seq;
+    uint16_t overruns;
+    uint32_t timestamp;
+    uint8_t data[SAMPLER_MAX_LEN];
+} sample_t;
+
+static sampler_job_t jobs[SAMPLER_MAX_JOBS];
+static sampler_job_t triggers[SAMPLER_MAX_TRIGGERS]; // the timer field is unused for triggers
+static uint8_t trigger_gpio[SAMPLER_MAX_TRIGGERS];
+static uint32_t trigger_edges[SAMPLER_MAX_TRIGGERS];
+// single consumer (main loop). The producers are the timer and GPIO interrupts, which don't preempt
+// each other, and sampler_push, which keeps interrupts off while it adds a sample
+static sample_t ring[SAMPLER_RING_SIZE];
+static volatile uint16_t ring_head = 0;
+static volatile uint16_t ring_tail = 0;
+
+// reads a sample into the ring. Called in interrupt context, by the timer or a GPIO edge
+static void
+sampler_capture(uint8_t source, uint8_t addr, int reg, uint8_t len, uint16_t *seq, uint16_t *overruns, uint32_t now)
+{
+    sample_t *s;
+    uint8_t r;
+    int retval;
+    uint16_t head = ring_head;
+    if ((!i2c_bus_free_for_irq()) || (((head + 1) & (SAMPLER_RING_SIZE - 1)) == ring_tail)) {
+        (*overruns)++;
+        (*seq)++;
+        return;
+    }
+    s = &ring[head];
+    if (reg >= 0) {
+        r = (uint8_t) reg;
+        retval = i2c_write_timeout_us(i2c_port, addr, &r, 1, true, SAMPLER_I2C_TIMEOUT_US);
+        if (retval < 0) {
+            i2c_port->restart_on_next = false;
+            (*overruns)++;
+            (*seq)++;
+            return;
+        }
+    }
+    retval = i2c_read_timeout_us(i2c_port, addr, s->data, len, false, SAMPLER_I2C_TIMEOUT_US);
+    if (retval < 0) {
+        (*overruns)++;
+        (*seq)++;
+        return;
+    }
+    s->job = source;
+    s->len = len;
+    s->seq = (*seq)++;
+    s->overruns = *overruns;
+    s->timestamp = now;
+    ring_head = (head + 1) & (SAMPLER_RING_SIZE - 1);
+}
+
+static bool
+sampler_timer_cb(repeating_timer_t *rt)
+{
+    sampler_job_t *j = (sampler_job_t *) rt->user_data;
+    sampler_capture((uint8_t) (j - jobs), j->addr, j->reg, j->len, &j->seq, &j->overruns, time_us_32());
+    return true;
+}
+
+static void
+sampler_gpio_cb(unsigned int gpio, uint32_t events)
+{
+    uint32_t now = time_us_32();
+    int i;
+    sampler_job_t *t;
+    for (i = 0; i < SAMPLER_MAX_TRIGGERS; i++) {
+        t = &triggers[i];
+        if (t->active && (trigger_gpio[i] == gpio) && (events & trigger_edges[i])) {
+            sampler_capture(SAMPLER_TRIGGER_SOURCE | i, t->addr, t->reg, t->len, &t->seq, &t->overruns, now);
+        }
+    }
+}
+
+int
+sampler_push(uint8_t source, uint16_t seq, uint16_t overruns, const uint8_t *data, uint8_t len, uint32_t now)
+{
+    sample_t *s;
+    uint16_t head;
+    uint8_t i;
+    uint32_t irq_state;
+    if (len > SAMPLER_MAX_LEN) {
+        return 0;
+    }
+    irq_state = save_and_disable_interrupts();
+    head = ring_head;
+    if (((head + 1) & (SAMPLER_RING_SIZE - 1)) == ring_tail) {
+        restore_interrupts(irq_state);
+        return 0;
+    }
+    s = &ring[head];
+    for (i = 0; i < len; i++) {
+        s->data[i] = data[i];
+    }
+    s->job = source;
+    s->len = len;
+    s->seq = seq;
+    s->overruns = overruns;
+    s->timestamp = now;
+    ring_head = (head + 1) & (SAMPLER_RING_SIZE - 1);
+    restore_interrupts(irq_state);
+    return 1;
+}
+
+int
+sampler_start(uint8_t job, uint8_t addr, int reg, uint8_t len, uint32_t period_us)
+{
+    sampler_job_t *j;
+    if ((job >= SAMPLER_MAX_JOBS) || (len == 0) || (len > SAMPLER_MAX_LEN) || (period_us < SAMPLER_MIN_PERIOD_US)) {
+        return 0;
+    }
+    sampler_stop(job);
+    j = &jobs[job];
+    j->addr = addr;
+    j->reg = reg;
+    j->len = len;
+    j->seq = 0;
+    j->overruns = 0;
+    // a negative delay keeps the period between the starts of each callback, so there is no drift
+    if (!add_repeating_timer_us(-((int64_t) period_us), sampler_timer_cb, j, &j->timer)) {
+        return 0;
+    }
+    j->active = 1;
+    return 1;
+}
+
+void
+sampler_stop(uint8_t job)
+{
+    if ((job < SAMPLER_MAX_JOBS) && jobs[job].active) {
+        cancel_repeating_timer(&jobs[job].timer);
+        jobs[job].active = 0;
+    }
+}
+
+void
+sampler_stop_all(void)
+{
+    uint8_t i;
+    for (i = 0; i < SAMPLER_MAX_JOBS; i++) {
+        sampler_stop(i);
+    }
+}
+
+int
+trigger_start(uint8_t n, uint8_t gpio, uint32_t edges, uint8_t addr, int reg, uint8_t len)
+{
+    sampler_job_t *t;
+    // a pin watched by something else, such as the SMBALERT# handler, is left alone
+    if ((n >= SAMPLER_MAX_TRIGGERS) || (len == 0) || (len > SAMPLER_MAX_LEN) || (edges == 0) ||
+        !gpioirq_available(gpio, sampler_gpio_cb)) {
+        return 0;
+    }
+    trigger_stop(n);
+    t = &triggers[n];
+    t->addr = addr;
+    t->reg = reg;
+    t->len = len;
+    t->seq = 0;
+    t->overruns = 0;
+    trigger_gpio[n] = gpio;
+    trigger_edges[n] = edges;
+    gpio_init(gpio);
+    gpio_set_dir(gpio, GPIO_IN);
+    gpio_pull_up(gpio); // INT outputs are often open-drain
+    gpioirq_attach(gpio, edges, sampler_gpio_cb);
+    t->active = 1;
+    return 1;
+}
+
+void
+trigger_stop(uint8_t n)
+{
+    int i;
+    uint32_t still_used = 0;
+    if ((n >= SAMPLER_MAX_TRIGGERS) || !triggers[n].active) {
+        return;
+    }
+    triggers[n].active = 0;
+    // another trigger may be using the same pin
+    for (i = 0; i < SAMPLER_MAX_TRIGGERS; i++) {
+        if (triggers[i].active && (trigger_gpio[i] == trigger_gpio[n])) {
+            still_used |= trigger_edges[i];
+        }
+    }
+    gpioirq_detach(trigger_gpio[n], trigger_edges[n] & ~still_used);
+}
+
+void
+trigger_stop_all(void)
+{
+    uint8_t i;
+    for (i = 0; i < SAMPLER_MAX_TRIGGERS; i++) {
+        trigger_stop(i);
+    }
+}
+
+int
+sampler_active(void)
+{
+    int i, n = 0;
+    for (i = 0; i < SAMPLER_MAX_JOBS; i++) {
+        n += jobs[i].active;
+    }
+    return n;
+}
+
+// builds the binary frame for a sample, returns its length
+static int
+sampler_format_frame(sample_t *s, uint8_t *frame)
+{
+    uint16_t crc;
+    int n = 0;
+    int i;
+    frame[n++] = SAMPLER_SYNC0;
+    frame[n++] = SAMPLER_SYNC1;
+    frame[n++] = s->job;
+    frame[n++] = s->seq & 0xff;
+    frame[n++] = s->seq >> 8;
+    frame[n++] = s->timestamp & 0xff;
+    frame[n++] = (s->timestamp >> 8) & 0xff;
+    frame[n++] = (s->timestamp >> 16) & 0xff;
+    frame[n++] = s->timestamp >> 24;
+    frame[n++] = s->overruns & 0xff;
+    frame[n++] = s->overruns >> 8;
+    frame[n++] = s->len;
+    for (i = 0; i < s->len; i++) {
+        frame[n++] = s->data[i];
+    }
+    crc = crc16_update(CRC16_INIT, &frame[2], n - 2);
+    frame[n++] = crc & 0xff;
+    frame[n++] = crc >> 8;
+    return n;
+}
+
+// builds the text line for a sample (interactive mode), returns its length
+static int
+sampler_format_text(sample_t *s, char *line, int size)
+{
+    static const char hex_digits[] = "0123456789ABCDEF";
+    int n, i;
+    char kind = 'S';
+    if (s->job & SAMPLER_TRIGGER_SOURCE) {
+        kind = 'T';
+    } else if (s->job & SAMPLER_ALERT_SOURCE) {
+        kind = 'A';
+    }
+    n = snprintf(line, size, "%c%d #%u %lu us (%u lost):", kind,
+                 s->job & ~(SAMPLER_TRIGGER_SOURCE | SAMPLER_ALERT_SOURCE), s->seq, (unsigned long) s->timestamp, s->overruns);
+    for (i = 0; i < s->len; i++) {
+        line[n++] = ' ';
+        line[n++] = hex_digits[s->data[i] >> 4];
+        line[n++] = hex_digits[s->data[i] & 0x0f];
+    }
+    line[n++] = '\r';
+    line[n++] = '\n';
+    return n;
+}
+
+// sends on the streaming interface if the PC has it open, otherwise along with the command responses.
+// returns 0 if the streaming interface has no room yet, the sample then stays in the ring
+static int
+sampler_emit(const uint8_t *buf, int len)
+{
+    if (usbio_stream_open()) {
+        if (usbio_stream_room() < (uint32_t) len) {
+            return 0;
+        }
+        usbio_stream_write(buf, (uint32_t) len);
+        return 1;
+    }
+    resp_write(buf, (uint16_t) len);
+    return 1;
+}
+
+void
+sampler_drain(int bin)
+{
+    uint8_t out[96]; // large enough for a frame or a text line of SAMPLER_MAX_LEN bytes
+    sample_t *s;
+    int n;
+    while (ring_tail != ring_head) {
+        s = &ring[ring_tail];
+        if (bin) {
+            n = sampler_format_frame(s, out);
+        } else {
+            n = sampler_format_text(s, (char *) out, sizeof(out));
+        }
+        if (!sampler_emit(out, n)) {
+            break; // the PC isn't keeping up, try again on the next pass
+        }
+        ring_tail = (ring_tail + 1) & (SAMPLER_RING_SIZE - 1);
+    }
+    if (usbio_stream_open()) {
+        usbio_stream_flush();
+    }
+}
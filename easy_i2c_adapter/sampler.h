@@ -0,0 +1,44 @@
+#ifndef _SAMPLER_HEADER_FILE_
+#define _SAMPLER_HEADER_FILE_
+
+/***********************************
+ * sampler.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+#define SAMPLER_MAX_JOBS 4
+#define SAMPLER_MAX_TRIGGERS 4
+#define SAMPLER_TRIGGER_SOURCE 0x80 // set in the job field of frames produced by a GPIO trigger
+#define SAMPLER_ALERT_SOURCE 0x40 // set in the job field of SMBALERT# event frames
+#define SAMPLER_MAX_LEN 16
+#define SAMPLER_MIN_PERIOD_US 250
+#define SAMPLER_RING_SIZE 64 // must be a power of 2
+#define SAMPLER_I2C_TIMEOUT_US 2000
+
+// binary sample frame, all multi-byte fields little-endian:
+// 0xA5 0x5A job seq[2] timestamp_us[4] overruns[2] len data[len] crc16[2]
+// the CRC-16/CCITT-FALSE covers everything after the two sync bytes
+#define SAMPLER_SYNC0 0xA5
+#define SAMPLER_SYNC1 0x5A
+
+// starts (or restarts) a periodic read of len bytes from addr, writing reg first unless reg is -1
+// returns 1 on success
+int sampler_start(uint8_t job, uint8_t addr, int reg, uint8_t len, uint32_t period_us);
+void sampler_stop(uint8_t job);
+void sampler_stop_all(void);
+// reads len bytes from addr (writing reg first unless it is -1) whenever one of the
+// GPIO_IRQ_EDGE_* events in edges occurs on gpio. Returns 1 on success
+int trigger_start(uint8_t n, uint8_t gpio, uint32_t edges, uint8_t addr, int reg, uint8_t len);
+void trigger_stop(uint8_t n);
+void trigger_stop_all(void);
+// adds a sample produced elsewhere (such as an SMBALERT# event) to the ring, returns 0 if it is full.
+// Can be called from the main loop or in interrupt context
+int sampler_push(uint8_t source, uint16_t seq, uint16_t overruns, const uint8_t *data, uint8_t len, uint32_t now);
+int sampler_active(void); // returns the number of running jobs
+// sends any queued samples; binary frames if bin is set, otherwise a line of text per sample.
+// They go to the streaming USB interface if the PC has it open, otherwise with the command responses
+void sampler_drain(int bin);
+
+#endif // _SAMPLER_HEADER_FILE_
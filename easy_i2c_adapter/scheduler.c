@@ -0,0 +1,185 @@
+/****************************************
+ * scheduler.c
+ * rev 1.0 Oct 2026
+ * I2C writes at absolute times, dispatched from a hardware alarm
+ * **************************************/
+
+#include <string.h>
+#include "scheduler.h"
+#include "buslock.h"
+#include "pico/stdlib.h"
+#include "hardware/timer.h"
+#include "hardware/sync.h"
+
+typedef struct sched_entry_s {
+    uint64_t deadline;
+    uint16_t id;
+    uint8_t addr;
+    uint8_t len;
+    uint8_t data[SCHED_MAX_LEN];
+} sched_entry_t;
+
+// binary min-heap ordered by deadline
+static sched_entry_t heap[SCHED_MAX_ENTRIES];
+static volatile uint8_t heap_len = 0;
+static sched_result_t results[SCHED_MAX_RESULTS];
+static volatile uint8_t results_head = 0;
+static volatile uint8_t results_tail = 0;
+static uint16_t next_id = 0;
+static int alarm_num = -1;
+
+static void
+heap_swap(int a, int b)
+{
+    sched_entry_t tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+}
+
+static void
+heap_push(sched_entry_t *e)
+{
+    int i = heap_len++;
+    heap[i] = *e;
+    while ((i > 0) && (heap[(i - 1) / 2].deadline > heap[i].deadline)) {
+        heap_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void
+heap_pop(sched_entry_t *e)
+{
+    int i = 0;
+    int c;
+    *e = heap[0];
+    heap[0] = heap[--heap_len];
+    while (1) {
+        c = 2 * i + 1;
+        if (c >= heap_len) {
+            break;
+        }
+        if ((c + 1 < heap_len) && (heap[c + 1].deadline < heap[c].deadline)) {
+            c++;
+        }
+        if (heap[i].deadline <= heap[c].deadline) {
+            break;
+        }
+        heap_swap(i, c);
+        i = c;
+    }
+}
+
+static void
+sched_add_result(uint16_t id, uint8_t status, uint64_t deadline, uint64_t start)
+{
+    uint8_t next = (results_head + 1) % SCHED_MAX_RESULTS;
+    if (next == results_tail) {
+        results_tail = (results_tail + 1) % SCHED_MAX_RESULTS; // full, the oldest result is lost
+    }
+    results[results_head].id = id;
+    results[results_head].status = status;
+    results[results_head].deadline = deadline;
+    results[results_head].start = start;
+    results_head = next;
+}
+
+// points the alarm at the earliest entry. Called with interrupts disabled, or from the alarm itself
+static void
+sched_arm(uint64_t target)
+{
+    if (heap_len == 0) {
+        hardware_alarm_cancel(alarm_num);
+        return;
+    }
+    if (target == 0) {
+        target = (heap[0].deadline > SCHED_LEAD_US) ? heap[0].deadline - SCHED_LEAD_US : 0;
+    }
+    if (hardware_alarm_set_target(alarm_num, from_us_since_boot(target))) {
+        // already in the past
+        hardware_alarm_force_irq(alarm_num);
+    }
+}
+
+static void
+sched_alarm_cb(unsigned int num)
+{
+    sched_entry_t e;
+    uint64_t start;
+    int retval;
+    while ((heap_len > 0) && (heap[0].deadline <= time_us_64() + SCHED_LEAD_US)) {
+        if (!i2c_bus_free_for_irq()) {
+            sched_arm(time_us_64() + SCHED_RETRY_US);
+            return;
+        }
+        heap_pop(&e);
+        while (time_us_64() < e.deadline) {
+            tight_loop_contents();
+        }
+        start = time_us_64();
+        retval = i2c_write_timeout_us(i2c_port, e.addr, e.data, e.len, false, SCHED_I2C_TIMEOUT_US);
+        sched_add_result(e.id, (retval < 0) ? SCHED_STATUS_NAK : SCHED_STATUS_OK, e.deadline, start);
+    }
+    sched_arm(0);
+}
+
+void
+sched_init(void)
+{
+    alarm_num = hardware_alarm_claim_unused(true);
+    hardware_alarm_set_callback(alarm_num, sched_alarm_cb);
+}
+
+int
+sched_add(uint64_t deadline, uint8_t addr, const uint8_t *buf, uint8_t len)
+{
+    sched_entry_t e;
+    uint32_t irq_state;
+    if ((len == 0) || (len > SCHED_MAX_LEN) || (heap_len >= SCHED_MAX_ENTRIES)) {
+        return -1;
+    }
+    e.deadline = deadline;
+    e.id = next_id++;
+    e.addr = addr;
+    e.len = len;
+    memcpy(e.data, buf, len);
+    irq_state = save_and_disable_interrupts();
+    heap_push(&e);
+    sched_arm(0);
+    restore_interrupts(irq_state);
+    return e.id;
+}
+
+void
+sched_clear(void)
+{
+    sched_entry_t e;
+    uint32_t irq_state = save_and_disable_interrupts();
+    while (heap_len > 0) {
+        heap_pop(&e);
+        sched_add_result(e.id, SCHED_STATUS_CANCELLED, e.deadline, 0);
+    }
+    sched_arm(0);
+    restore_interrupts(irq_state);
+}
+
+int
+sched_pending(void)
+{
+    return heap_len;
+}
+
+int
+sched_get_result(sched_result_t *r)
+{
+    uint32_t irq_state;
+    int found = 0;
+    irq_state = save_and_disable_interrupts();
+    if (results_tail != results_head) {
+        *r = results[results_tail];
+        results_tail = (results_tail + 1) % SCHED_MAX_RESULTS;
+        found = 1;
+    }
+    restore_interrupts(irq_state);
+    return found;
+}
@@ -0,0 +1,37 @@
+#ifndef _SCHEDULER_HEADER_FILE_
+#define _SCHEDULER_HEADER_FILE_
+
+/***********************************
+ * scheduler.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+#define SCHED_MAX_ENTRIES 16
+#define SCHED_MAX_LEN 16
+#define SCHED_MAX_RESULTS 32
+#define SCHED_LEAD_US 30 // the alarm fires this early, and the remainder is spent busy-waiting
+#define SCHED_RETRY_US 50 // retry interval if the command path is using the bus at the deadline
+#define SCHED_I2C_TIMEOUT_US 5000
+#define SCHED_STATUS_OK 0
+#define SCHED_STATUS_NAK 1
+#define SCHED_STATUS_CANCELLED 2
+
+typedef struct sched_result_s {
+    uint16_t id;
+    uint8_t status;
+    uint64_t deadline;
+    uint64_t start; // actual time the transfer started
+} sched_result_t;
+
+void sched_init(void);
+// queues an I2C write to start at time deadline (in time_us_64 units)
+// returns the transaction id, or -1 if the queue is full or the length is invalid
+int sched_add(uint64_t deadline, uint8_t addr, const uint8_t *buf, uint8_t len);
+void sched_clear(void); // cancels everything that hasn't started
+int sched_pending(void); // number of queued transactions
+// copies out the next completed result, returns 0 if there are none
+int sched_get_result(sched_result_t *r);
+
+#endif // _SCHEDULER_HEADER_FILE_
@@ -0,0 +1,163 @@
+/****************************************
+ * script.c
+ * rev 1.0 Oct 2026
+ * command scripts stored in flash
+ * **************************************/
+
+#include <string.h>
+#include "script.h"
+#include "crc.h"
+#include "pico/stdlib.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+
+_Static_assert(sizeof(script_header_t) == SCRIPT_HEADER_SIZE, "script header size");
+
+// the whole sector is assembled in RAM, then written in one go
+static uint8_t record_buf[FLASH_SECTOR_SIZE];
+static uint32_t record_len = 0;
+static uint8_t record_id = 0;
+static uint8_t recording = 0;
+static uint8_t record_overflow = 0;
+
+static uint32_t
+slot_offset(uint8_t id)
+{
+    return SCRIPT_FLASH_OFFSET + (uint32_t) id * FLASH_SECTOR_SIZE;
+}
+
+int
+script_record_begin(uint8_t id, const char *name)
+{
+    script_header_t *hdr = (script_header_t *) record_buf;
+    if (id >= SCRIPT_SLOTS) {
+        return 0;
+    }
+    memset(hdr, 0, sizeof(script_header_t));
+    strncpy(hdr->name, name, SCRIPT_NAME_MAX - 1);
+    record_id = id;
+    record_len = 0;
+    record_overflow = 0;
+    recording = 1;
+    return 1;
+}
+
+int
+script_recording(void)
+{
+    return recording;
+}
+
+int
+script_record_token(const char *token)
+{
+    uint32_t n = strlen(token);
+    char *text = (char *) &record_buf[SCRIPT_HEADER_SIZE];
+    if ((record_len + n + 1) > SCRIPT_TEXT_MAX) {
+        record_overflow = 1;
+        return 0;
+    }
+    if ((record_len > 0) && (text[record_len - 1] != SCRIPT_LINE_END)) {
+        text[record_len++] = ' ';
+    }
+    memcpy(&text[record_len], token, n);
+    record_len += n;
+    return 1;
+}
+
+void
+script_record_line_end(void)
+{
+    char *text = (char *) &record_buf[SCRIPT_HEADER_SIZE];
+    // empty lines aren't kept
+    if ((record_len == 0) || (text[record_len - 1] == SCRIPT_LINE_END) || (record_len >= SCRIPT_TEXT_MAX)) {
+        return;
+    }
+    text[record_len++] = SCRIPT_LINE_END;
+}
+
+void
+script_record_cancel(void)
+{
+    recording = 0;
+}
+
+int
+script_check(const char *text, uint32_t len)
+{
+    uint32_t i = 0;
+    uint32_t start;
+    int depth = 0;
+    while (i < len) {
+        start = i;
+        while ((i < len) && (text[i] != ' ') && (text[i] != SCRIPT_LINE_END)) {
+            if ((text[i] == '$') && ((i + 1 >= len) || (text[i + 1] < '0') || (text[i + 1] >= '0' + SCRIPT_MAX_PARAMS))) {
+                return 0;
+            }
+            i++;
+        }
+        if (((i - start) > 5) && (strncmp(&text[start], "loop:", 5) == 0)) {
+            if (++depth > SCRIPT_LOOP_DEPTH) {
+                return 0;
+            }
+        } else if (((i - start) == 7) && (strncmp(&text[start], "endloop", 7) == 0)) {
+            if (--depth < 0) {
+                return 0;
+            }
+        }
+        i++;
+    }
+    return (depth == 0);
+}
+
+int
+script_record_end(void)
+{
+    script_header_t *hdr = (script_header_t *) record_buf;
+    uint32_t ints;
+    uint32_t count;
+    recording = 0;
+    if (record_overflow || !script_check((const char *) &record_buf[SCRIPT_HEADER_SIZE], record_len)) {
+        return 0;
+    }
+    hdr->magic = SCRIPT_MAGIC;
+    hdr->len = record_len;
+    hdr->crc = crc32_update(CRC32_INIT, &record_buf[SCRIPT_HEADER_SIZE], record_len) ^ CRC32_XOROUT;
+    // only the pages holding the script are programmed
+    count = (SCRIPT_HEADER_SIZE + record_len + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1);
+    ints = save_and_disable_interrupts();
+    flash_range_erase(slot_offset(record_id), FLASH_SECTOR_SIZE);
+    flash_range_program(slot_offset(record_id), record_buf, count);
+    restore_interrupts(ints);
+    return (script_get(record_id) != NULL) ? 1 : -1;
+}
+
+const script_header_t *
+script_get(uint8_t id)
+{
+    const script_header_t *hdr;
+    if (id >= SCRIPT_SLOTS) {
+        return NULL;
+    }
+    hdr = (const script_header_t *) (uintptr_t) (XIP_BASE + slot_offset(id));
+    if ((hdr->magic != SCRIPT_MAGIC) || (hdr->len > SCRIPT_TEXT_MAX)) {
+        return NULL;
+    }
+    if ((crc32_update(CRC32_INIT, (const uint8_t *) hdr + SCRIPT_HEADER_SIZE, hdr->len) ^ CRC32_XOROUT) != hdr->crc) {
+        return NULL;
+    }
+    return hdr;
+}
+
+int
+script_delete(uint8_t id)
+{
+    uint32_t ints;
+    if (id >= SCRIPT_SLOTS) {
+        return 0;
+    }
+    ints = save_and_disable_interrupts();
+    flash_range_erase(slot_offset(id), FLASH_SECTOR_SIZE);
+    restore_interrupts(ints);
+    return 1;
+}
@@ -0,0 +1,52 @@
+#ifndef _SCRIPT_HEADER_FILE_
+#define _SCRIPT_HEADER_FILE_
+
+/***********************************
+ * script.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+#include "config.h"
+
+// each script has a flash sector of its own, just below the settings sectors
+#define SCRIPT_SLOTS 8
+#define SCRIPT_FLASH_OFFSET (CONFIG_FLASH_OFFSET - SCRIPT_SLOTS * FLASH_SECTOR_SIZE)
+#define SCRIPT_MAGIC 0x54524353 // "SCRT"
+#define SCRIPT_NAME_MAX 20
+#define SCRIPT_HEADER_SIZE 32
+#define SCRIPT_TEXT_MAX (FLASH_SECTOR_SIZE - SCRIPT_HEADER_SIZE)
+#define SCRIPT_MAX_PARAMS 8
+#define SCRIPT_LOOP_DEPTH 4
+#define SCRIPT_LINE_END '\n' // stored in the text where the uploaded line ended
+#define SCRIPT_DEFAULT_STEPS 100000 // commands and loop passes per run, changed with script_limit:
+#define SCRIPT_MAX_STEPS 10000000
+#define SCRIPT_USB_SERVICE_STEPS 256 // how often a long run lets the USB stack run
+
+// the script text is the uploaded tokens separated by spaces, with SCRIPT_LINE_END at the end of each line
+typedef struct script_header_s {
+    uint32_t magic;
+    uint32_t len; // length of the text, which follows the header
+    uint32_t crc; // CRC-32 of the text
+    char name[SCRIPT_NAME_MAX]; // NUL-terminated
+} script_header_t;
+
+// starts collecting a script in RAM. Returns 1 on success, 0 if id is out of range
+int script_record_begin(uint8_t id, const char *name);
+int script_recording(void); // returns 1 while a script is being collected
+// adds a token to the script being collected. Returns 0 if it doesn't fit
+int script_record_token(const char *token);
+void script_record_line_end(void);
+// checks the collected script and writes it to flash. Returns 1 on success, 0 if there is
+// an error in the script (see script_check), -1 if flash couldn't be written
+int script_record_end(void);
+void script_record_cancel(void);
+// checks that loops are balanced and not nested too deeply, and that parameters are in range.
+// Returns 1 if the script is valid
+int script_check(const char *text, uint32_t len);
+// returns the stored script in slot id, or NULL if the slot is empty or its contents are damaged.
+// The text follows the header in flash
+const script_header_t *script_get(uint8_t id);
+int script_delete(uint8_t id);
+
+#endif // _SCRIPT_HEADER_FILE_
@@ -0,0 +1,229 @@
+/****************************************
+ * smbus.c
+ * rev 1.0 Oct 2026
+ * SMBus transfers with PEC, driven through the I2C command register
+ * **************************************/
+
+#include "smbus.h"
+#include "buslock.h"
+#include "crc.h"
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+
+typedef struct smbus_xfer_s {
+    i2c_hw_t *hw;
+    uint64_t deadline;
+    uint8_t pec;
+    uint8_t failed;
+    uint8_t aborted; // the transfer timed out, and was aborted to release the bus
+} smbus_xfer_t;
+
+static void
+xfer_begin(smbus_xfer_t *x, uint8_t addr)
+{
+    x->hw = i2c_get_hw(i2c_port);
+    x->deadline = time_us_64() + SMBUS_TIMEOUT_US;
+    x->pec = CRC8_INIT;
+    x->failed = 0;
+    x->aborted = 0;
+    x->hw->enable = 0;
+    x->hw->tar = addr;
+    x->hw->enable = 1;
+    (void) x->hw->clr_tx_abrt;
+    (void) x->hw->clr_stop_det;
+}
+
+// stops a transfer that has run out of time. Reads queued without a stop would otherwise
+// leave SCL held low until the next transfer disabled the block
+static void
+xfer_timeout(smbus_xfer_t *x)
+{
+    i2c_abort_transfer(i2c_port);
+    x->failed = 1;
+    x->aborted = 1;
+}
+
+// returns 1 if the transfer is still good. An abort (no acknowledge) makes the I2C block
+// flush its FIFO and send a stop by itself
+static int
+xfer_ok(smbus_xfer_t *x)
+{
+    if (x->failed) {
+        return 0;
+    }
+    if (x->hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) {
+        (void) x->hw->clr_tx_abrt;
+        x->failed = 1;
+    } else if (time_us_64() > x->deadline) {
+        xfer_timeout(x);
+    }
+    return !x->failed;
+}
+
+// queues a command (a byte to write, or a read), waiting for room in the FIFO
+static int
+xfer_push(smbus_xfer_t *x, uint32_t cmd)
+{
+    while (!(x->hw->status & I2C_IC_STATUS_TFNF_BITS)) {
+        if (!xfer_ok(x)) {
+            return 0;
+        }
+    }
+    x->hw->data_cmd = cmd;
+    return 1;
+}
+
+static int
+xfer_write(smbus_xfer_t *x, uint8_t b, uint32_t flags)
+{
+    x->pec = crc8_byte(x->pec, b);
+    return xfer_push(x, b | flags);
+}
+
+// reads one byte; the PEC is updated unless this is the PEC byte itself
+static int
+xfer_read(smbus_xfer_t *x, uint8_t *b, uint32_t flags, int is_pec)
+{
+    if (!xfer_push(x, I2C_IC_DATA_CMD_CMD_BITS | flags)) {
+        return 0;
+    }
+    while (x->hw->rxflr == 0) {
+        if (!xfer_ok(x)) {
+            return 0;
+        }
+    }
+    *b = (uint8_t) x->hw->data_cmd;
+    if (!is_pec) {
+        x->pec = crc8_byte(x->pec, *b);
+    }
+    return 1;
+}
+
+// waits for the stop condition, and returns SMBUS_OK or SMBUS_ERR_BUS
+static int
+xfer_end(smbus_xfer_t *x)
+{
+    while (!x->aborted && !(x->hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS)) {
+        if (time_us_64() > x->deadline) {
+            xfer_timeout(x);
+        }
+    }
+    (void) x->hw->clr_stop_det;
+    xfer_ok(x); // a late abort, such as no acknowledge for the last byte written
+    i2c_port->restart_on_next = false;
+    return x->failed ? SMBUS_ERR_BUS : SMBUS_OK;
+}
+
+// the write phase of a read: the address with the write bit and wbuf, ending without a stop
+static int
+xfer_write_phase(smbus_xfer_t *x, uint8_t addr, const uint8_t *wbuf, uint16_t wlen)
+{
+    uint16_t i;
+    uint32_t first = i2c_port->restart_on_next ? I2C_IC_DATA_CMD_RESTART_BITS : 0;
+    if (wlen == 0) {
+        return 1;
+    }
+    x->pec = crc8_byte(x->pec, (uint8_t) (addr << 1));
+    for (i = 0; i < wlen; i++) {
+        if (!xfer_write(x, wbuf[i], (i == 0) ? first : 0)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int
+smbus_write(uint8_t addr, const uint8_t *buf, uint16_t len, int pec)
+{
+    smbus_xfer_t x;
+    uint16_t i;
+    uint32_t flags;
+    xfer_begin(&x, addr);
+    x.pec = crc8_byte(x.pec, (uint8_t) (addr << 1));
+    for (i = 0; i < len; i++) {
+        flags = ((i == 0) && i2c_port->restart_on_next) ? I2C_IC_DATA_CMD_RESTART_BITS : 0;
+        if ((i == len - 1) && !pec) {
+            flags |= I2C_IC_DATA_CMD_STOP_BITS;
+        }
+        if (!xfer_write(&x, buf[i], flags)) {
+            return xfer_end(&x);
+        }
+    }
+    if (pec) {
+        xfer_push(&x, x.pec | I2C_IC_DATA_CMD_STOP_BITS);
+    }
+    return xfer_end(&x);
+}
+
+int
+smbus_read(uint8_t addr, const uint8_t *wbuf, uint16_t wlen, uint8_t *rbuf, uint16_t len, int pec)
+{
+    smbus_xfer_t x;
+    uint16_t i;
+    uint16_t total = len + (pec ? 1 : 0);
+    uint32_t flags;
+    uint8_t rx_pec = 0;
+    int retval;
+    xfer_begin(&x, addr);
+    if (!xfer_write_phase(&x, addr, wbuf, wlen)) {
+        return xfer_end(&x);
+    }
+    x.pec = crc8_byte(x.pec, (uint8_t) ((addr << 1) | 1));
+    for (i = 0; i < total; i++) {
+        flags = ((i == 0) && ((wlen > 0) || i2c_port->restart_on_next)) ? I2C_IC_DATA_CMD_RESTART_BITS : 0;
+        if (i == total - 1) {
+            flags |= I2C_IC_DATA_CMD_STOP_BITS;
+        }
+        if (!xfer_read(&x, (i < len) ? &rbuf[i] : &rx_pec, flags, (i >= len))) {
+            return xfer_end(&x);
+        }
+    }
+    retval = xfer_end(&x);
+    if ((retval == SMBUS_OK) && pec && (rx_pec != x.pec)) {
+        return SMBUS_ERR_PEC;
+    }
+    return retval;
+}
+
+int
+smbus_block_read(uint8_t addr, const uint8_t *wbuf, uint16_t wlen, uint8_t *rbuf, uint16_t *len, int pec)
+{
+    smbus_xfer_t x;
+    uint8_t count;
+    uint16_t i;
+    uint16_t total;
+    uint8_t rx_pec = 0;
+    uint8_t dummy;
+    int retval;
+    *len = 0;
+    xfer_begin(&x, addr);
+    if (!xfer_write_phase(&x, addr, wbuf, wlen)) {
+        return xfer_end(&x);
+    }
+    x.pec = crc8_byte(x.pec, (uint8_t) ((addr << 1) | 1));
+    // the bus is held (SCL low) after the count byte, until the following reads are queued
+    if (!xfer_read(&x, &count, ((wlen > 0) || i2c_port->restart_on_next) ? I2C_IC_DATA_CMD_RESTART_BITS : 0, 0)) {
+        return xfer_end(&x);
+    }
+    if (count == 0) {
+        // a read must be queued to end the transfer, since the count byte was read without a stop
+        xfer_read(&x, &dummy, I2C_IC_DATA_CMD_STOP_BITS, 1);
+        xfer_end(&x);
+        return SMBUS_ERR_LEN;
+    }
+    total = count + (pec ? 1 : 0);
+    for (i = 0; i < total; i++) {
+        if (!xfer_read(&x, (i < count) ? &rbuf[i] : &rx_pec, (i == total - 1) ? I2C_IC_DATA_CMD_STOP_BITS : 0, (i >= count))) {
+            return xfer_end(&x);
+        }
+    }
+    retval = xfer_end(&x);
+    if (retval != SMBUS_OK) {
+        return retval;
+    }
+    *len = count;
+    if (pec && (rx_pec != x.pec)) {
+        return SMBUS_ERR_PEC;
+    }
+    return SMBUS_OK;
+}
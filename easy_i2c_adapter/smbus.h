@@ -0,0 +1,30 @@
+#ifndef _SMBUS_HEADER_FILE_
+#define _SMBUS_HEADER_FILE_
+
+/***********************************
+ * smbus.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+#define SMBUS_BLOCK_MAX 255 // SMBus 3.0 block length
+#define SMBUS_TIMEOUT_US 35000 // whole transaction, the SMBus clock low timeout is 25-35 ms
+#define SMBUS_OK 0
+#define SMBUS_ERR_BUS -1 // no acknowledge, or timeout
+#define SMBUS_ERR_PEC -2 // the PEC byte from the device didn't match
+#define SMBUS_ERR_LEN -3 // the block count from the device was 0
+
+// the transfers drive the I2C block's command register directly, so that the PEC (CRC-8) is computed
+// byte by byte as the transfer runs, and so that a block read can use the count byte to decide how many
+// bytes follow. With pec set, a PEC byte is appended to writes, and expected after reads
+
+// a write-only transaction: the bytes of buf (command code and data)
+int smbus_write(uint8_t addr, const uint8_t *buf, uint16_t len, int pec);
+// writes wbuf (usually the command code, can be empty), then after a repeated start reads len bytes
+int smbus_read(uint8_t addr, const uint8_t *wbuf, uint16_t wlen, uint8_t *rbuf, uint16_t len, int pec);
+// as smbus_read, but the first byte read is the count of the bytes that follow.
+// The data (without the count) is stored in rbuf, and *len is set to the count
+int smbus_block_read(uint8_t addr, const uint8_t *wbuf, uint16_t wlen, uint8_t *rbuf, uint16_t *len, int pec);
+
+#endif // _SMBUS_HEADER_FILE_
@@ -0,0 +1,32 @@
+#ifndef _TUSB_CONFIG_H_
+#define _TUSB_CONFIG_H_
+
+/***********************************
+ * tusb_config.h
+ * rev 1.0 Oct 2026
+ * TinyUSB configuration, the adapter is a composite USB device with two CDC interfaces
+ * (commands, and streamed data) and a vendor-class bulk interface
+ * *********************************/
+
+#define CFG_TUSB_RHPORT0_MODE (OPT_MODE_DEVICE)
+#ifndef CFG_TUSB_OS
+#define CFG_TUSB_OS OPT_OS_PICO
+#endif
+
+#define CFG_TUD_ENDPOINT0_SIZE 64
+
+#define CFG_TUD_CDC 2
+#define CFG_TUD_MSC 0
+#define CFG_TUD_HID 0
+#define CFG_TUD_MIDI 0
+#define CFG_TUD_VENDOR 1
+
+// FIFO sizes, large enough to hold several full-speed packets each way
+#define CFG_TUD_CDC_RX_BUFSIZE 512
+#define CFG_TUD_CDC_TX_BUFSIZE 512
+#define CFG_TUD_CDC_EP_BUFSIZE 64
+#define CFG_TUD_VENDOR_RX_BUFSIZE 512
+#define CFG_TUD_VENDOR_TX_BUFSIZE 512
+#define CFG_TUD_VENDOR_EPSIZE 64
+
+#endif // _TUSB_CONFIG_H_
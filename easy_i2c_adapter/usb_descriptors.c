@@ -0,0 +1,187 @@
+/****************************************
+ * usb_descriptors.c
+ * rev 1.0 Oct 2026
+ * USB device, configuration and string descriptors
+ * **************************************/
+
+#include <string.h>
+#include "pico/unique_id.h"
+#include "pico/bootrom.h"
+#include "tusb.h"
+
+// same IDs as the Pico SDK's USB stdio, so hosts see the adapter as before. Any Pico running
+// SDK stdio has these IDs too, so the device release number (the SDK uses 0x0100) and the
+// interface names are what tell the adapter apart
+#define USBD_VID 0x2E8A // Raspberry Pi
+#define USBD_PID 0x000A // Raspberry Pi Pico SDK CDC
+#define USBD_BCD_DEVICE 0x0200
+
+#define ITF_NUM_CDC 0
+#define ITF_NUM_CDC_DATA 1
+#define ITF_NUM_CDC_STREAM 2
+#define ITF_NUM_CDC_STREAM_DATA 3
+#define ITF_NUM_VENDOR 4
+#define ITF_NUM_TOTAL 5
+
+#define EPNUM_CDC_NOTIF 0x81
+#define EPNUM_CDC_OUT 0x02
+#define EPNUM_CDC_IN 0x82
+#define EPNUM_VENDOR_OUT 0x03
+#define EPNUM_VENDOR_IN 0x83
+#define EPNUM_CDC_STREAM_NOTIF 0x84
+#define EPNUM_CDC_STREAM_OUT 0x05
+#define EPNUM_CDC_STREAM_IN 0x85
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + (2 * TUD_CDC_DESC_LEN) + TUD_VENDOR_DESC_LEN)
+
+#define STRID_LANGID 0
+#define STRID_MANUFACTURER 1
+#define STRID_PRODUCT 2
+#define STRID_SERIAL 3
+#define STRID_CDC 4
+#define STRID_VENDOR 5
+#define STRID_CDC_STREAM 6
+
+// Windows fetches the MS OS 2.0 descriptor with this vendor request, and then binds WinUSB to the
+// vendor interface, so libusb can open it without a driver being installed
+#define VENDOR_REQUEST_MICROSOFT 1
+#define MS_OS_20_DESC_LEN 0xB2
+#define BOS_TOTAL_LEN (TUD_BOS_DESC_LEN + TUD_BOS_MICROSOFT_OS_DESC_LEN)
+
+static const tusb_desc_device_t device_desc = {
+    .bLength = sizeof(tusb_desc_device_t),
+    .bDescriptorType = TUSB_DESC_DEVICE,
+    .bcdUSB = 0x0210, // 2.1, for the BOS descriptor
+    // IAD is used for the CDC interfaces
+    .bDeviceClass = TUSB_CLASS_MISC,
+    .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+    .idVendor = USBD_VID,
+    .idProduct = USBD_PID,
+    .bcdDevice = USBD_BCD_DEVICE,
+    .iManufacturer = STRID_MANUFACTURER,
+    .iProduct = STRID_PRODUCT,
+    .iSerialNumber = STRID_SERIAL,
+    .bNumConfigurations = 1,
+};
+
+static const uint8_t config_desc[] = {
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, STRID_CDC, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_STREAM, STRID_CDC_STREAM, EPNUM_CDC_STREAM_NOTIF, 8, EPNUM_CDC_STREAM_OUT,
+                       EPNUM_CDC_STREAM_IN, 64),
+    TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, STRID_VENDOR, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN, 64),
+};
+
+static const uint8_t bos_desc[] = {
+    TUD_BOS_DESCRIPTOR(BOS_TOTAL_LEN, 1),
+    TUD_BOS_MS_OS_20_DESCRIPTOR(MS_OS_20_DESC_LEN, VENDOR_REQUEST_MICROSOFT),
+};
+
+static const uint8_t ms_os_20_desc[] = {
+    // set header: length, type, Windows version, total length
+    U16_TO_U8S_LE(0x000A), U16_TO_U8S_LE(MS_OS_20_SET_HEADER_DESCRIPTOR), U32_TO_U8S_LE(0x06030000),
+    U16_TO_U8S_LE(MS_OS_20_DESC_LEN),
+    // configuration subset header: length, type, configuration index, reserved, subset length
+    U16_TO_U8S_LE(0x0008), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_CONFIGURATION), 0, 0,
+    U16_TO_U8S_LE(MS_OS_20_DESC_LEN - 0x0A),
+    // function subset header: length, type, first interface, reserved, subset length
+    U16_TO_U8S_LE(0x0008), U16_TO_U8S_LE(MS_OS_20_SUBSET_HEADER_FUNCTION), ITF_NUM_VENDOR, 0,
+    U16_TO_U8S_LE(MS_OS_20_DESC_LEN - 0x0A - 0x08),
+    // compatible ID: length, type, "WINUSB", no sub-compatible ID
+    U16_TO_U8S_LE(0x0014), U16_TO_U8S_LE(MS_OS_20_FEATURE_COMPATBLE_ID), 'W', 'I', 'N', 'U', 'S', 'B', 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    // registry property: length, type, data type (REG_MULTI_SZ), name length, name, data length, data
+    U16_TO_U8S_LE(MS_OS_20_DESC_LEN - 0x0A - 0x08 - 0x08 - 0x14), U16_TO_U8S_LE(MS_OS_20_FEATURE_REG_PROPERTY),
+    U16_TO_U8S_LE(0x0007), U16_TO_U8S_LE(0x002A),
+    'D', 0, 'e', 0, 'v', 0, 'i', 0, 'c', 0, 'e', 0, 'I', 0, 'n', 0, 't', 0, 'e', 0, 'r', 0, 'f', 0, 'a', 0, 'c', 0,
+    'e', 0, 'G', 0, 'U', 0, 'I', 0, 'D', 0, 's', 0, 0, 0,
+    U16_TO_U8S_LE(0x0050),
+    '{', 0, '4', 0, 'F', 0, 'B', 0, '4', 0, 'D', 0, 'C', 0, 'F', 0, '1', 0, '-', 0, 'A', 0, '3', 0, 'E', 0,
+    'A', 0, '-', 0, '4', 0, '9', 0, 'B', 0, '4', 0, '-', 0, '8', 0, '0', 0, 'F', 0, '3', 0, '-', 0, '1', 0,
+    'B', 0, '9', 0, '2', 0, 'E', 0, 'B', 0, 'E', 0, '7', 0, '0', 0, '9', 0, '5', 0, '8', 0, '}', 0, 0, 0,
+    0, 0,
+};
+
+TU_VERIFY_STATIC(sizeof(ms_os_20_desc) == MS_OS_20_DESC_LEN, "MS OS 2.0 descriptor length");
+
+static const char *const string_desc[] = {
+    [STRID_MANUFACTURER] = "Raspberry Pi",
+    [STRID_PRODUCT] = "Easy I2C Adapter",
+    [STRID_SERIAL] = NULL, // from the flash chip's unique ID
+    [STRID_CDC] = "Easy I2C Adapter",
+    [STRID_VENDOR] = "Easy I2C Adapter bulk",
+    [STRID_CDC_STREAM] = "Easy I2C Adapter data",
+};
+
+static uint16_t string_buf[33];
+
+const uint8_t *
+tud_descriptor_device_cb(void) {
+    return (const uint8_t *) &device_desc;
+}
+
+const uint8_t *
+tud_descriptor_configuration_cb(uint8_t index) {
+    (void) index;
+    return config_desc;
+}
+
+const uint8_t *
+tud_descriptor_bos_cb(void) {
+    return bos_desc;
+}
+
+// answers the MS OS 2.0 descriptor request, other vendor requests are not supported
+bool
+tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const *request) {
+    if (stage != CONTROL_STAGE_SETUP) {
+        return true;
+    }
+    if ((request->bmRequestType_bit.type == TUSB_REQ_TYPE_VENDOR) &&
+        (request->bRequest == VENDOR_REQUEST_MICROSOFT) && (request->wIndex == 7)) {
+        return tud_control_xfer(rhport, request, (void *) (uintptr_t) ms_os_20_desc, MS_OS_20_DESC_LEN);
+    }
+    return false;
+}
+
+const uint16_t *
+tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+    const char *str;
+    uint8_t len, i;
+    (void) langid;
+    if (index == STRID_LANGID) {
+        string_buf[1] = 0x0409; // English
+        len = 1;
+    } else {
+        if (index >= sizeof(string_desc) / sizeof(string_desc[0])) {
+            return NULL;
+        }
+        if (index == STRID_SERIAL) {
+            pico_get_unique_board_id_string(serial, sizeof(serial));
+            str = serial;
+        } else {
+            str = string_desc[index];
+        }
+        len = (uint8_t) strlen(str);
+        if (len > 32) {
+            len = 32;
+        }
+        for (i = 0; i < len; i++) {
+            string_buf[1 + i] = str[i];
+        }
+    }
+    string_buf[0] = (uint16_t) ((TUSB_DESC_STRING << 8) | (2 * len + 2));
+    return string_buf;
+}
+
+// as with the SDK's USB stdio, opening the port at 1200 baud reboots into the USB bootloader,
+// so that new firmware can be loaded without pressing BOOTSEL
+void
+tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const *coding) {
+    if ((itf == 0) && (coding->bit_rate == 1200)) {
+        reset_usb_boot(0, 0);
+    }
+}
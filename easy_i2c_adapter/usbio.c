@@ -0,0 +1,188 @@
+/****************************************
+ * usbio.c
+ * rev 1.0 Oct 2026
+ * USB transport, using TinyUSB directly rather than stdio. Commands can arrive on the first CDC
+ * interface (terminals, pyserial) or on the vendor-class bulk interface (libusb). The second CDC
+ * interface carries streamed data (sample frames), so that it never holds up command responses
+ * **************************************/
+
+#include "pico/stdlib.h"
+#include "tusb.h"
+#include "usbio.h"
+
+static uint8_t rx_packet[USBIO_PACKET_SIZE];
+static uint32_t rx_len = 0;
+static uint32_t rx_pos = 0;
+static uint8_t rx_port = USBIO_PORT_CDC; // interface the current input came from, replies go back there
+static uint8_t at_line_start = 1;
+static volatile uint8_t announced = 0; // set once the command port has been opened since the last mount
+static volatile uint8_t connect_event = 0;
+
+static int
+port_connected(uint8_t port) {
+    if (port == USBIO_PORT_VENDOR) {
+        return tud_vendor_mounted() ? 1 : 0;
+    }
+    return tud_cdc_n_connected(USBIO_CDC_CONTROL) ? 1 : 0;
+}
+
+static uint32_t
+port_read(uint8_t port, uint8_t *buf, uint32_t len) {
+    if (port == USBIO_PORT_VENDOR) {
+        return tud_vendor_available() ? tud_vendor_read(buf, len) : 0;
+    }
+    return tud_cdc_n_available(USBIO_CDC_CONTROL) ? tud_cdc_n_read(USBIO_CDC_CONTROL, buf, len) : 0;
+}
+
+static uint32_t
+port_write(uint8_t port, const uint8_t *buf, uint32_t len) {
+    if (port == USBIO_PORT_VENDOR) {
+        return tud_vendor_write(buf, len);
+    }
+    return tud_cdc_n_write(USBIO_CDC_CONTROL, buf, len);
+}
+
+static void
+port_flush(uint8_t port) {
+    if (port == USBIO_PORT_VENDOR) {
+        tud_vendor_write_flush();
+    } else {
+        tud_cdc_n_write_flush(USBIO_CDC_CONTROL);
+    }
+}
+
+// fetches the next packet. A different interface is only switched to between lines,
+// so that a command line is never mixed with input from the other interface
+static int
+fill_packet(void) {
+    uint8_t port;
+    for (port = 0; port < USBIO_NUM_PORTS; port++) {
+        if (!at_line_start && (port != rx_port)) {
+            continue;
+        }
+        rx_len = port_read(port, rx_packet, sizeof(rx_packet));
+        if (rx_len > 0) {
+            rx_pos = 0;
+            rx_port = port;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// TinyUSB callbacks
+void
+tud_mount_cb(void) {
+    announced = 0;
+}
+
+void
+tud_umount_cb(void) {
+    announced = 0;
+    connect_event = 0;
+}
+
+void
+tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts) {
+    (void) rts;
+    if ((itf == USBIO_CDC_CONTROL) && dtr && !announced) {
+        announced = 1;
+        connect_event = 1;
+    }
+}
+
+void
+usbio_init(void) {
+    tusb_init();
+}
+
+void
+usbio_task(void) {
+    tud_task();
+    tud_cdc_n_read_flush(USBIO_CDC_STREAM); // the streaming interface is output only
+}
+
+int
+usbio_connected(void) {
+    return port_connected(rx_port);
+}
+
+int
+usbio_connect_event(void) {
+    if (!connect_event) {
+        return 0;
+    }
+    connect_event = 0;
+    return 1;
+}
+
+void
+usbio_send_ready(const uint8_t *buf, uint32_t len) {
+    tud_cdc_n_write(USBIO_CDC_CONTROL, buf, len);
+    tud_cdc_n_write_flush(USBIO_CDC_CONTROL);
+}
+
+int
+usbio_getc(uint32_t timeout_us) {
+    uint64_t t0 = time_us_64();
+    int c;
+    while (rx_pos >= rx_len) {
+        tud_task();
+        // take a whole packet at once, later calls are served from it
+        if (fill_packet()) {
+            break;
+        }
+        if ((time_us_64() - t0) >= timeout_us) {
+            return PICO_ERROR_TIMEOUT;
+        }
+    }
+    c = rx_packet[rx_pos++];
+    at_line_start = (c == '\r') ? 1 : 0;
+    return c;
+}
+
+void
+usbio_write(const uint8_t *buf, uint32_t len) {
+    uint32_t sent = 0;
+    uint64_t t0;
+    if (!port_connected(rx_port)) {
+        return; // nobody is listening
+    }
+    t0 = time_us_64();
+    while (sent < len) {
+        sent += port_write(rx_port, &buf[sent], len - sent);
+        if (sent < len) {
+            // the FIFO is full, let the USB stack send some of it
+            port_flush(rx_port);
+            tud_task();
+            if ((time_us_64() - t0) > USBIO_TX_TIMEOUT_US) {
+                return;
+            }
+        }
+    }
+}
+
+void
+usbio_flush(void) {
+    port_flush(rx_port);
+}
+
+int
+usbio_stream_open(void) {
+    return tud_cdc_n_connected(USBIO_CDC_STREAM) ? 1 : 0;
+}
+
+uint32_t
+usbio_stream_room(void) {
+    return tud_cdc_n_write_available(USBIO_CDC_STREAM);
+}
+
+void
+usbio_stream_write(const uint8_t *buf, uint32_t len) {
+    tud_cdc_n_write(USBIO_CDC_STREAM, buf, len);
+}
+
+void
+usbio_stream_flush(void) {
+    tud_cdc_n_write_flush(USBIO_CDC_STREAM);
+}
@@ -0,0 +1,45 @@
+#ifndef _USBIO_HEADER_FILE_
+#define _USBIO_HEADER_FILE_
+
+/***********************************
+ * usbio.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+#define USBIO_CDC_CONTROL 0 // CDC interface numbers, as used by TinyUSB
+#define USBIO_CDC_STREAM 1
+
+// interfaces that commands can arrive on
+#define USBIO_PORT_CDC 0
+#define USBIO_PORT_VENDOR 1
+#define USBIO_NUM_PORTS 2
+
+#define USBIO_PACKET_SIZE 64
+#define USBIO_TX_TIMEOUT_US 500000 // give up on a write if the PC stops reading for this long
+
+void usbio_init(void);
+// services the USB stack, must be called often, including during long operations
+void usbio_task(void);
+// returns 1 if the PC has the interface of the current command open (DTR set, for CDC)
+int usbio_connected(void);
+// returns 1 (once) when the command port is first opened after the adapter is plugged in or reset
+int usbio_connect_event(void);
+// sends a message directly on the command port, regardless of where the last command came from
+void usbio_send_ready(const uint8_t *buf, uint32_t len);
+// returns the next received byte, waiting up to timeout_us for it, or PICO_ERROR_TIMEOUT
+int usbio_getc(uint32_t timeout_us);
+// queues bytes for sending, exactly as given, on the interface the current command came from.
+// Output is dropped if that interface isn't open
+void usbio_write(const uint8_t *buf, uint32_t len);
+// sends any queued bytes now, without waiting for a full packet
+void usbio_flush(void);
+
+// the streaming interface. Writes never wait: check usbio_stream_room first
+int usbio_stream_open(void); // returns 1 if the PC has the streaming port open
+uint32_t usbio_stream_room(void);
+void usbio_stream_write(const uint8_t *buf, uint32_t len);
+void usbio_stream_flush(void);
+
+#endif // _USBIO_HEADER_FILE_
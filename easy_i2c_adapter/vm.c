@@ -0,0 +1,403 @@
+/****************************************
+ * vm.c
+ * rev 1.0 Oct 2026
+ * bytecode interpreter for device logic, with a verifier
+ * **************************************/
+
+#include <string.h>
+#include "vm.h"
+#include "buslock.h"
+#include "usbio.h"
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+
+// operand kinds, used by the verifier
+#define F_NONE 0 // must be zero
+#define F_REG 1
+#define F_IMM 2
+#define F_TARGET 3
+#define F_ADDR7 4
+#define F_PIN 5
+#define F_MEMOFF 6
+#define F_MEMLEN 7 // block length, mem[b] to mem[b + c - 1] must be in range
+
+#define USB_SERVICE_STEPS 1024 // how often a long run lets the USB stack run
+
+static const uint8_t op_fmt[VM_OP_COUNT][3] = {
+    [VM_HALT] = {F_NONE, F_NONE, F_NONE},
+    [VM_LDI] = {F_REG, F_IMM, F_IMM},
+    [VM_LDHI] = {F_REG, F_IMM, F_IMM},
+    [VM_MOV] = {F_REG, F_REG, F_NONE},
+    [VM_ADD] = {F_REG, F_REG, F_REG},
+    [VM_SUB] = {F_REG, F_REG, F_REG},
+    [VM_AND] = {F_REG, F_REG, F_REG},
+    [VM_OR] = {F_REG, F_REG, F_REG},
+    [VM_XOR] = {F_REG, F_REG, F_REG},
+    [VM_SHL] = {F_REG, F_REG, F_REG},
+    [VM_SHR] = {F_REG, F_REG, F_REG},
+    [VM_MUL] = {F_REG, F_REG, F_REG},
+    [VM_ADDI] = {F_REG, F_IMM, F_IMM},
+    [VM_JMP] = {F_NONE, F_NONE, F_TARGET},
+    [VM_JEQ] = {F_REG, F_REG, F_TARGET},
+    [VM_JNE] = {F_REG, F_REG, F_TARGET},
+    [VM_JLT] = {F_REG, F_REG, F_TARGET},
+    [VM_JGE] = {F_REG, F_REG, F_TARGET},
+    [VM_JZ] = {F_REG, F_NONE, F_TARGET},
+    [VM_JNZ] = {F_REG, F_NONE, F_TARGET},
+    [VM_CALL] = {F_NONE, F_NONE, F_TARGET},
+    [VM_RET] = {F_NONE, F_NONE, F_NONE},
+    [VM_PUSH] = {F_REG, F_NONE, F_NONE},
+    [VM_POP] = {F_REG, F_NONE, F_NONE},
+    [VM_ADDR] = {F_ADDR7, F_NONE, F_NONE},
+    [VM_ADDRR] = {F_REG, F_NONE, F_NONE},
+    [VM_RD8] = {F_REG, F_REG, F_NONE},
+    [VM_WR8] = {F_REG, F_REG, F_NONE},
+    [VM_RD16] = {F_REG, F_REG, F_NONE},
+    [VM_WR16] = {F_REG, F_REG, F_NONE},
+    [VM_I2CW] = {F_NONE, F_MEMOFF, F_MEMLEN},
+    [VM_I2CR] = {F_NONE, F_MEMOFF, F_MEMLEN},
+    [VM_LDM] = {F_REG, F_MEMOFF, F_NONE},
+    [VM_STM] = {F_REG, F_MEMOFF, F_NONE},
+    [VM_GPW] = {F_PIN, F_REG, F_NONE},
+    [VM_GPR] = {F_REG, F_PIN, F_NONE},
+    [VM_DELAY] = {F_REG, F_NONE, F_NONE},
+    [VM_DELAYI] = {F_NONE, F_IMM, F_IMM},
+    [VM_OUT] = {F_REG, F_NONE, F_NONE},
+};
+
+// the opcodes that exist, there are gaps in the numbering
+static const uint8_t op_defined[VM_OP_COUNT] = {
+    [VM_HALT] = 1, [VM_LDI] = 1, [VM_LDHI] = 1, [VM_MOV] = 1, [VM_ADD] = 1, [VM_SUB] = 1, [VM_AND] = 1,
+    [VM_OR] = 1, [VM_XOR] = 1, [VM_SHL] = 1, [VM_SHR] = 1, [VM_MUL] = 1, [VM_ADDI] = 1,
+    [VM_JMP] = 1, [VM_JEQ] = 1, [VM_JNE] = 1, [VM_JLT] = 1, [VM_JGE] = 1, [VM_JZ] = 1, [VM_JNZ] = 1,
+    [VM_CALL] = 1, [VM_RET] = 1, [VM_PUSH] = 1, [VM_POP] = 1,
+    [VM_ADDR] = 1, [VM_ADDRR] = 1, [VM_RD8] = 1, [VM_WR8] = 1, [VM_RD16] = 1, [VM_WR16] = 1,
+    [VM_I2CW] = 1, [VM_I2CR] = 1, [VM_LDM] = 1, [VM_STM] = 1,
+    [VM_GPW] = 1, [VM_GPR] = 1, [VM_DELAY] = 1, [VM_DELAYI] = 1, [VM_OUT] = 1,
+};
+
+static uint8_t prog[VM_MAX_INSNS * 4];
+static uint16_t prog_len = 0; // in bytes
+static uint16_t load_len = 0;
+static uint8_t verified = 0;
+static uint32_t step_limit = VM_DEFAULT_STEPS;
+static uint32_t pin_mask = 0;
+
+void
+vm_init(uint32_t gpio_mask)
+{
+    pin_mask = gpio_mask;
+}
+
+int
+vm_load_begin(uint32_t len)
+{
+    if ((len == 0) || (len > sizeof(prog)) || ((len & 3) != 0)) {
+        return 0;
+    }
+    prog_len = (uint16_t) len;
+    load_len = 0;
+    verified = 0;
+    return 1;
+}
+
+int
+vm_load_byte(uint8_t val)
+{
+    prog[load_len++] = val;
+    return (load_len < prog_len) ? 1 : 0;
+}
+
+static int
+operand_ok(uint8_t kind, uint8_t v, uint8_t b)
+{
+    switch (kind) {
+        case F_NONE:
+            return (v == 0);
+        case F_REG:
+            return (v < VM_NUM_REGS);
+        case F_IMM:
+            return 1;
+        case F_TARGET:
+            return (v < prog_len / 4);
+        case F_ADDR7:
+            return (v <= 0x7f);
+        case F_PIN:
+            return (v < 32) && ((pin_mask >> v) & 1);
+        case F_MEMOFF:
+            return (v < VM_MEM_SIZE);
+        case F_MEMLEN:
+            return (v > 0) && ((uint32_t) b + v <= VM_MEM_SIZE);
+        default:
+            return 0;
+    }
+}
+
+int
+vm_verify(void)
+{
+    uint16_t i;
+    const uint8_t *insn;
+    verified = 0;
+    if ((prog_len == 0) || (load_len != prog_len)) {
+        return 0;
+    }
+    for (i = 0; i < prog_len / 4; i++) {
+        insn = &prog[i * 4];
+        if ((insn[0] >= VM_OP_COUNT) || !op_defined[insn[0]]) {
+            return i;
+        }
+        if (!operand_ok(op_fmt[insn[0]][0], insn[1], 0) || !operand_ok(op_fmt[insn[0]][1], insn[2], 0) ||
+            !operand_ok(op_fmt[insn[0]][2], insn[3], insn[2])) {
+            return i;
+        }
+    }
+    verified = 1;
+    return -1;
+}
+
+void
+vm_set_step_limit(uint32_t steps)
+{
+    step_limit = steps;
+}
+
+static void
+vm_delay(uint32_t us)
+{
+    uint64_t end = time_us_64() + us;
+    while (time_us_64() < end) {
+        usbio_task();
+        sleep_us(((end - time_us_64()) > 1000) ? 1000 : 10);
+    }
+}
+
+// a register read: write the register address, then read len bytes after a repeated start
+static int
+vm_reg_read(uint8_t addr, uint8_t reg, uint8_t *buf, uint8_t len)
+{
+    if (i2c_write_timeout_us(i2c_port, addr, &reg, 1, true, VM_I2C_TIMEOUT_US) != 1) {
+        i2c_port->restart_on_next = false;
+        return 0;
+    }
+    return (i2c_read_timeout_us(i2c_port, addr, buf, len, false, VM_I2C_TIMEOUT_US) == len);
+}
+
+void
+vm_run(const int32_t *args, int nargs, vm_result_t *res)
+{
+    int32_t r[VM_NUM_REGS];
+    int32_t stack[VM_STACK_SIZE];
+    uint8_t mem[VM_MEM_SIZE];
+    uint8_t sp = 0;
+    uint16_t pc = 0;
+    uint16_t ninsns = prog_len / 4;
+    uint8_t addr = 0;
+    uint8_t buf[3];
+    const uint8_t *insn;
+    int32_t imm;
+    uint8_t a, b, c;
+    int ok;
+    memset(r, 0, sizeof(r));
+    memset(mem, 0, sizeof(mem));
+    memcpy(r, args, (nargs > VM_NUM_REGS ? VM_NUM_REGS : nargs) * sizeof(int32_t));
+    res->status = VM_OK;
+    res->steps = 0;
+    res->out_len = 0;
+    if (!verified) {
+        res->status = VM_ERR_NO_PROGRAM;
+        res->pc = 0;
+        res->r0 = 0;
+        return;
+    }
+    // the verifier has checked every operand, so only the stack and output need run-time checks
+    while (pc < ninsns) {
+        if (res->steps >= step_limit) {
+            res->status = VM_ERR_STEPS;
+            break;
+        }
+        res->steps++;
+        if ((res->steps % USB_SERVICE_STEPS) == 0) {
+            usbio_task();
+        }
+        insn = &prog[pc * 4];
+        a = insn[1];
+        b = insn[2];
+        c = insn[3];
+        imm = (int16_t) (b | (c << 8));
+        pc++;
+        switch (insn[0]) {
+            case VM_HALT:
+                pc = ninsns;
+                continue;
+            case VM_LDI:
+                r[a] = imm;
+                break;
+            case VM_LDHI:
+                r[a] = (int32_t) (((uint32_t) r[a] & 0xffff) | ((uint32_t) (imm & 0xffff) << 16));
+                break;
+            case VM_MOV:
+                r[a] = r[b];
+                break;
+            case VM_ADD:
+                r[a] = (int32_t) ((uint32_t) r[b] + (uint32_t) r[c]);
+                break;
+            case VM_SUB:
+                r[a] = (int32_t) ((uint32_t) r[b] - (uint32_t) r[c]);
+                break;
+            case VM_AND:
+                r[a] = r[b] & r[c];
+                break;
+            case VM_OR:
+                r[a] = r[b] | r[c];
+                break;
+            case VM_XOR:
+                r[a] = r[b] ^ r[c];
+                break;
+            case VM_SHL:
+                r[a] = (int32_t) ((uint32_t) r[b] << (r[c] & 31));
+                break;
+            case VM_SHR:
+                r[a] = (int32_t) ((uint32_t) r[b] >> (r[c] & 31));
+                break;
+            case VM_MUL:
+                r[a] = (int32_t) ((uint32_t) r[b] * (uint32_t) r[c]);
+                break;
+            case VM_ADDI:
+                r[a] = (int32_t) ((uint32_t) r[a] + (uint32_t) imm);
+                break;
+            case VM_JMP:
+                pc = c;
+                break;
+            case VM_JEQ:
+                if (r[a] == r[b]) {
+                    pc = c;
+                }
+                break;
+            case VM_JNE:
+                if (r[a] != r[b]) {
+                    pc = c;
+                }
+                break;
+            case VM_JLT:
+                if (r[a] < r[b]) {
+                    pc = c;
+                }
+                break;
+            case VM_JGE:
+                if (r[a] >= r[b]) {
+                    pc = c;
+                }
+                break;
+            case VM_JZ:
+                if (r[a] == 0) {
+                    pc = c;
+                }
+                break;
+            case VM_JNZ:
+                if (r[a] != 0) {
+                    pc = c;
+                }
+                break;
+            case VM_CALL:
+            case VM_PUSH:
+                if (sp >= VM_STACK_SIZE) {
+                    res->status = VM_ERR_STACK;
+                    break;
+                }
+                if (insn[0] == VM_CALL) {
+                    stack[sp++] = pc;
+                    pc = c;
+                } else {
+                    stack[sp++] = r[a];
+                }
+                break;
+            case VM_RET:
+            case VM_POP:
+                if (sp == 0) {
+                    res->status = VM_ERR_STACK;
+                    break;
+                }
+                if (insn[0] == VM_RET) {
+                    // a return address popped by POP and pushed back as data could be anything
+                    pc = (uint16_t) stack[--sp];
+                    if (pc > ninsns) {
+                        pc = ninsns;
+                    }
+                } else {
+                    r[a] = stack[--sp];
+                }
+                break;
+            case VM_ADDR:
+                addr = a;
+                break;
+            case VM_ADDRR:
+                addr = (uint8_t) (r[a] & 0x7f);
+                break;
+            case VM_RD8:
+            case VM_RD16:
+                ok = vm_reg_read(addr, (uint8_t) r[b], buf, (insn[0] == VM_RD8) ? 1 : 2);
+                if (ok) {
+                    r[a] = (insn[0] == VM_RD8) ? buf[0] : ((buf[0] << 8) | buf[1]);
+                }
+                r[VM_STATUS_REG] = ok ? 0 : 1;
+                break;
+            case VM_WR8:
+            case VM_WR16:
+                buf[0] = (uint8_t) r[a];
+                if (insn[0] == VM_WR8) {
+                    buf[1] = (uint8_t) r[b];
+                } else {
+                    buf[1] = (uint8_t) (r[b] >> 8);
+                    buf[2] = (uint8_t) r[b];
+                }
+                ok = (i2c_write_timeout_us(i2c_port, addr, buf, (insn[0] == VM_WR8) ? 2 : 3, false, VM_I2C_TIMEOUT_US) ==
+                      ((insn[0] == VM_WR8) ? 2 : 3));
+                r[VM_STATUS_REG] = ok ? 0 : 1;
+                break;
+            case VM_I2CW:
+                ok = (i2c_write_timeout_us(i2c_port, addr, &mem[b], c, false, VM_I2C_TIMEOUT_US) == c);
+                r[VM_STATUS_REG] = ok ? 0 : 1;
+                break;
+            case VM_I2CR:
+                ok = (i2c_read_timeout_us(i2c_port, addr, &mem[b], c, false, VM_I2C_TIMEOUT_US) == c);
+                r[VM_STATUS_REG] = ok ? 0 : 1;
+                break;
+            case VM_LDM:
+                r[a] = mem[b];
+                break;
+            case VM_STM:
+                mem[b] = (uint8_t) r[a];
+                break;
+            case VM_GPW:
+                gpio_init(a);
+                gpio_set_dir(a, GPIO_OUT);
+                gpio_put(a, r[b] & 1);
+                break;
+            case VM_GPR:
+                r[a] = gpio_get(b) ? 1 : 0;
+                break;
+            case VM_DELAY:
+                vm_delay(((uint32_t) r[a] > VM_DELAY_MAX_US) ? VM_DELAY_MAX_US : (uint32_t) r[a]);
+                break;
+            case VM_DELAYI:
+                vm_delay((uint32_t) (imm & 0xffff));
+                break;
+            case VM_OUT:
+                if (res->out_len >= VM_OUT_MAX) {
+                    res->status = VM_ERR_OUT;
+                    break;
+                }
+                res->out[res->out_len++] = (uint8_t) r[a];
+                break;
+            default:
+                break;
+        }
+        if (res->status != VM_OK) {
+            pc--; // report the instruction that failed
+            break;
+        }
+    }
+    res->pc = pc;
+    res->r0 = r[0];
+}
@@ -0,0 +1,97 @@
+#ifndef _VM_HEADER_FILE_
+#define _VM_HEADER_FILE_
+
+/***********************************
+ * vm.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+// a small virtual machine for running device logic (branches, loops) on the adapter.
+// Instructions are 4 bytes: opcode, a, b, c. Where an instruction takes a 16-bit immediate,
+// it is b + 256 * c. Jump targets are instruction numbers, in c
+#define VM_MAX_INSNS 256
+#define VM_NUM_REGS 16
+#define VM_STATUS_REG 15 // set by I2C instructions: 0 if the transfer succeeded, 1 if not
+#define VM_MEM_SIZE 64 // byte memory, for block transfers
+#define VM_STACK_SIZE 16 // shared by PUSH/POP and CALL/RET
+#define VM_OUT_MAX 128 // bytes that can be returned by OUT
+#define VM_MAX_ARGS 8 // vm_run parameters, loaded into r0 upwards
+#define VM_DEFAULT_STEPS 100000
+#define VM_MAX_STEPS 10000000
+#define VM_DELAY_MAX_US 1000000
+#define VM_I2C_TIMEOUT_US 5000
+
+// opcodes. ra, rb, rc are register numbers
+#define VM_HALT 0x00
+#define VM_LDI 0x01 // ra = imm16, sign-extended
+#define VM_LDHI 0x02 // upper 16 bits of ra = imm16
+#define VM_MOV 0x03 // ra = rb
+#define VM_ADD 0x04 // ra = rb + rc
+#define VM_SUB 0x05 // ra = rb - rc
+#define VM_AND 0x06
+#define VM_OR 0x07
+#define VM_XOR 0x08
+#define VM_SHL 0x09 // ra = rb << (rc & 31)
+#define VM_SHR 0x0A // logical shift
+#define VM_MUL 0x0B
+#define VM_ADDI 0x0C // ra = ra + imm16, sign-extended
+#define VM_JMP 0x10 // jump to c
+#define VM_JEQ 0x11 // jump to c if ra == rb
+#define VM_JNE 0x12
+#define VM_JLT 0x13 // signed compare
+#define VM_JGE 0x14
+#define VM_JZ 0x15 // jump to c if ra == 0
+#define VM_JNZ 0x16
+#define VM_CALL 0x17 // push the return address and jump to c
+#define VM_RET 0x18
+#define VM_PUSH 0x19 // push ra
+#define VM_POP 0x1A // pop into ra
+#define VM_ADDR 0x20 // I2C address = a (0-0x7f)
+#define VM_ADDRR 0x21 // I2C address = ra & 0x7f
+#define VM_RD8 0x22 // ra = 8-bit register rb
+#define VM_WR8 0x23 // 8-bit register ra = rb
+#define VM_RD16 0x24 // ra = 16-bit register rb, MSB first
+#define VM_WR16 0x25 // 16-bit register ra = rb, MSB first
+#define VM_I2CW 0x26 // write c bytes from mem[b]
+#define VM_I2CR 0x27 // read c bytes to mem[b]
+#define VM_LDM 0x28 // ra = mem[b]
+#define VM_STM 0x29 // mem[b] = ra
+#define VM_GPW 0x30 // GPIO a = rb & 1
+#define VM_GPR 0x31 // ra = GPIO b
+#define VM_DELAY 0x32 // wait ra microseconds (up to VM_DELAY_MAX_US)
+#define VM_DELAYI 0x33 // wait imm16 microseconds
+#define VM_OUT 0x34 // return the low byte of ra to the PC
+#define VM_OP_COUNT 0x35
+
+// results
+#define VM_OK 0
+#define VM_ERR_STEPS 1 // the step limit was reached
+#define VM_ERR_STACK 2 // stack overflow or underflow
+#define VM_ERR_OUT 3 // too much output
+#define VM_ERR_NO_PROGRAM 4
+
+typedef struct vm_result_s {
+    int status;
+    uint32_t steps;
+    uint16_t pc; // instruction that was running when it stopped
+    int32_t r0;
+    uint8_t out[VM_OUT_MAX];
+    uint16_t out_len;
+} vm_result_t;
+
+// gpio_mask has a bit set for each GPIO pin that programs may use
+void vm_init(uint32_t gpio_mask);
+// starts loading a program of len bytes, returns 0 if the length isn't a whole number of instructions, or too long
+int vm_load_begin(uint32_t len);
+// adds a byte of the program. Returns 1 while more bytes are expected, 0 when the program is complete
+int vm_load_byte(uint8_t val);
+// checks every instruction of the loaded program. Returns -1 if it is valid, otherwise the number
+// of the first bad instruction. A program can only be run once it has been verified
+int vm_verify(void);
+void vm_set_step_limit(uint32_t steps);
+// runs the program, with r0 upwards set to args. The I2C bus must be reserved by the caller
+void vm_run(const int32_t *args, int nargs, vm_result_t *res);
+
+#endif // _VM_HEADER_FILE_
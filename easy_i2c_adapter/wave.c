@@ -0,0 +1,282 @@
+/****************************************
+ * wave.c
+ * rev 1.0 Oct 2026
+ * register/DAC waveform playback: a repeating timer paces the samples,
+ * and DMA feeds each sample's I2C data commands to the I2C block
+ * **************************************/
+
+#include "wave.h"
+#include "buslock.h"
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+
+static uint16_t words[WAVE_MAX_WORDS];
+static int dma_chan = -1;
+static repeating_timer_t wave_timer;
+static volatile uint8_t playing = 0;
+
+static uint8_t w_addr;
+static int w_reg;
+static uint8_t w_frame;
+static uint8_t w_wps; // data command words per sample
+static uint32_t w_rate;
+static uint8_t w_loop;
+static uint32_t w_capacity; // samples, whole buffer in loop mode or each half in streaming mode
+
+// loop mode
+static uint32_t loop_len = 0; // samples loaded
+static uint32_t loop_pos = 0;
+// streaming mode
+static volatile uint8_t half_ready[2];
+static uint32_t half_count[2];
+static uint8_t play_half = 0;
+static uint32_t play_pos = 0;
+static uint8_t next_fill_half = 0;
+
+// fill state
+static uint32_t fill_base; // first sample being filled
+static uint32_t fill_bytes;
+static uint32_t fill_index;
+static int fill_half; // -1 in loop mode
+
+static volatile uint32_t played = 0;
+static volatile uint32_t underruns = 0;
+static volatile uint32_t errors = 0;
+
+void
+wave_init(void)
+{
+    dma_channel_config c;
+    dma_chan = dma_claim_unused_channel(true);
+    c = dma_channel_get_default_config(dma_chan);
+    // 16-bit writes are replicated across the 32-bit bus, and the upper half of IC_DATA_CMD is ignored
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, i2c_get_dreq(i2c_port, true));
+    dma_channel_configure(dma_chan, &c, &i2c_get_hw(i2c_port)->data_cmd, words, 0, false);
+}
+
+int
+wave_config(uint8_t addr, int reg, uint8_t frame_bytes, uint32_t rate_hz, int loop)
+{
+    if ((frame_bytes == 0) || (frame_bytes > WAVE_MAX_FRAME) || (rate_hz == 0) || (rate_hz > WAVE_MAX_RATE) ||
+        (reg > 255)) {
+        return 0;
+    }
+    wave_stop();
+    w_addr = addr;
+    w_reg = reg;
+    w_frame = frame_bytes;
+    w_wps = frame_bytes + ((reg >= 0) ? 1 : 0);
+    w_rate = rate_hz;
+    w_loop = loop ? 1 : 0;
+    w_capacity = WAVE_MAX_WORDS / w_wps;
+    if (!w_loop) {
+        w_capacity /= 2;
+    }
+    loop_len = 0;
+    loop_pos = 0;
+    half_ready[0] = 0;
+    half_ready[1] = 0;
+    play_half = 0;
+    play_pos = 0;
+    next_fill_half = 0;
+    fill_bytes = 0;
+    return 1;
+}
+
+int
+wave_fill_begin(uint32_t nbytes)
+{
+    if ((w_frame == 0) || (nbytes == 0) || ((nbytes % w_frame) != 0)) {
+        return 0;
+    }
+    if (w_loop) {
+        if (playing || (loop_len + (nbytes / w_frame) > w_capacity)) {
+            return 0;
+        }
+        fill_half = -1;
+        fill_base = loop_len;
+    } else {
+        if (half_ready[next_fill_half] || ((nbytes / w_frame) > w_capacity)) {
+            return 0;
+        }
+        fill_half = next_fill_half;
+        fill_base = fill_half * w_capacity;
+    }
+    fill_bytes = nbytes;
+    fill_index = 0;
+    return 1;
+}
+
+int
+wave_fill_byte(uint8_t b)
+{
+    uint32_t sample;
+    uint8_t k;
+    uint16_t *p;
+    if (fill_index >= fill_bytes) {
+        return WAVE_FILL_ERROR;
+    }
+    sample = fill_base + (fill_index / w_frame);
+    k = fill_index % w_frame;
+    p = &words[sample * w_wps];
+    if (w_reg >= 0) {
+        p[0] = (uint8_t) w_reg;
+        p++;
+    }
+    // the last byte of each sample carries the STOP, the I2C block issues the START and address itself
+    p[k] = b | ((k == w_frame - 1) ? I2C_IC_DATA_CMD_STOP_BITS : 0);
+    fill_index++;
+    if (fill_index < fill_bytes) {
+        return WAVE_FILL_MORE;
+    }
+    if (fill_half < 0) {
+        loop_len += fill_bytes / w_frame;
+    } else {
+        half_count[fill_half] = fill_bytes / w_frame;
+        half_ready[fill_half] = 1;
+        next_fill_half ^= 1;
+    }
+    return WAVE_FILL_DONE;
+}
+
+static bool
+wave_timer_cb(repeating_timer_t *rt)
+{
+    i2c_hw_t *hw = i2c_get_hw(i2c_port);
+    uint32_t sample;
+    if (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) {
+        (void) hw->clr_tx_abrt; // the device didn't acknowledge; the I2C block dropped that sample
+        errors++;
+    }
+    if (dma_channel_is_busy(dma_chan) || (hw->txflr > 0) || (i2c_bus_busy != 0) || i2c_port->restart_on_next) {
+        underruns++;
+        return true;
+    }
+    if (w_loop) {
+        sample = loop_pos;
+        loop_pos++;
+        if (loop_pos >= loop_len) {
+            loop_pos = 0;
+        }
+    } else {
+        if (!half_ready[play_half]) {
+            underruns++;
+            return true;
+        }
+        sample = (play_half * w_capacity) + play_pos;
+        play_pos++;
+        if (play_pos >= half_count[play_half]) {
+            half_ready[play_half] = 0; // the PC can refill it now
+            play_half ^= 1;
+            play_pos = 0;
+        }
+    }
+    // other engines address other devices, so the target may need to be set again
+    if (hw->tar != w_addr) {
+        hw->enable = 0;
+        hw->tar = w_addr;
+        hw->enable = 1;
+    }
+    dma_channel_transfer_from_buffer_now(dma_chan, &words[sample * w_wps], w_wps);
+    played++;
+    return true;
+}
+
+int
+wave_start(void)
+{
+    if (playing || (w_frame == 0)) {
+        return 0;
+    }
+    if (w_loop && (loop_len == 0)) {
+        return 0;
+    }
+    played = 0;
+    underruns = 0;
+    errors = 0;
+    // a negative delay keeps the period between the starts of each callback, so there is no drift
+    if (!add_repeating_timer_us(-((int64_t) (1000000 / w_rate)), wave_timer_cb, NULL, &wave_timer)) {
+        return 0;
+    }
+    playing = 1;
+    return 1;
+}
+
+void
+wave_stop(void)
+{
+    if (!playing) {
+        return;
+    }
+    cancel_repeating_timer(&wave_timer);
+    playing = 0;
+    while (wave_bus_active()) {
+        tight_loop_contents(); // let the last sample finish
+    }
+    if (!w_loop) {
+        half_ready[0] = 0;
+        half_ready[1] = 0;
+        play_half = 0;
+        play_pos = 0;
+        next_fill_half = 0;
+    }
+}
+
+int
+wave_playing(void)
+{
+    return playing;
+}
+
+uint32_t
+wave_samples_played(void)
+{
+    return played;
+}
+
+uint32_t
+wave_underruns(void)
+{
+    return underruns;
+}
+
+uint32_t
+wave_errors(void)
+{
+    return errors;
+}
+
+int
+wave_free_halves(void)
+{
+    if (w_loop) {
+        return 0;
+    }
+    return (half_ready[0] ? 0 : 1) + (half_ready[1] ? 0 : 1);
+}
+
+int
+wave_capacity(void)
+{
+    return (int) w_capacity;
+}
+
+uint8_t
+wave_addr(void)
+{
+    return w_addr;
+}
+
+int
+wave_bus_active(void)
+{
+    if (dma_chan < 0) {
+        return 0;
+    }
+    return dma_channel_is_busy(dma_chan) || (i2c_get_hw(i2c_port)->txflr > 0) ||
+           (i2c_get_hw(i2c_port)->status & I2C_IC_STATUS_ACTIVITY_BITS);
+}
@@ -0,0 +1,37 @@
+#ifndef _WAVE_HEADER_FILE_
+#define _WAVE_HEADER_FILE_
+
+/***********************************
+ * wave.h
+ * rev 1.0 Oct 2026
+ * *********************************/
+
+#include <stdint.h>
+
+#define WAVE_MAX_WORDS 12288 // I2C data commands; each sample takes (register ? 1 : 0) + frame bytes
+#define WAVE_MAX_FRAME 4
+#define WAVE_MAX_RATE 20000
+#define WAVE_FILL_ERROR 0
+#define WAVE_FILL_MORE 1
+#define WAVE_FILL_DONE 2
+
+void wave_init(void);
+// sets up playback of frames of frame_bytes bytes to addr, each preceded by reg unless reg is -1.
+// in loop mode the whole buffer repeats; otherwise it is played as two halves that the PC refills
+// returns 0 if the parameters are invalid
+int wave_config(uint8_t addr, int reg, uint8_t frame_bytes, uint32_t rate_hz, int loop);
+// prepares to receive nbytes of frame data; returns 0 if there's no room (try again later when streaming)
+int wave_fill_begin(uint32_t nbytes);
+int wave_fill_byte(uint8_t b); // returns one of WAVE_FILL_*
+int wave_start(void);
+void wave_stop(void);
+int wave_playing(void);
+uint32_t wave_samples_played(void);
+uint32_t wave_underruns(void);
+uint32_t wave_errors(void);
+int wave_free_halves(void); // streaming mode: halves waiting to be refilled
+int wave_capacity(void); // samples per buffer (loop mode) or per half (streaming mode)
+uint8_t wave_addr(void); // the device the waveform is played to
+int wave_bus_active(void); // returns 1 while a sample is being sent
+
+#endif // _WAVE_HEADER_FILE_
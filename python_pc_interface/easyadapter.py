@@ -8,19 +8,153 @@ from array import *
 import time
 import sys
 
+# the adapter's vendor-class bulk interface, accessed through libusb (requires pyusb)
+# this provides the same write/read/in_waiting/close calls as a pyserial port, so it can be used in its place
+class UsbBulkPort:
+    VID = 0x2E8A
+    PID = 0x000A
+    BCD_DEVICE = 0x0200  # other Pico SDK devices share the VID and PID, but not this
+    INTERFACE_NAME = "Easy I2C Adapter bulk"
+
+    def __init__(self, dev):
+        import usb.util
+        self.dev = dev
+        itf = UsbBulkPort.bulk_interface(dev)
+        if itf is None:
+            raise ValueError("device has no Easy I2C Adapter bulk interface")
+        self.ep_out = usb.util.find_descriptor(itf, custom_match=lambda e: usb.util.endpoint_direction(
+            e.bEndpointAddress) == usb.util.ENDPOINT_OUT)
+        self.ep_in = usb.util.find_descriptor(itf, custom_match=lambda e: usb.util.endpoint_direction(
+            e.bEndpointAddress) == usb.util.ENDPOINT_IN)
+        if self.ep_out is None or self.ep_in is None:
+            raise ValueError("Easy I2C Adapter bulk interface has no endpoints")
+        self.rx = bytearray()
+
+    # returns the adapter's bulk interface, or None if dev doesn't have one. A Pico running SDK stdio
+    # also has a vendor-class interface (for reset), but it has no endpoints and a different name
+    @staticmethod
+    def bulk_interface(dev):
+        import usb.util
+        try:
+            for itf in dev.get_active_configuration():
+                if itf.bInterfaceClass == 0xFF and itf.bNumEndpoints == 2 and itf.iInterface != 0 and \
+                        usb.util.get_string(dev, itf.iInterface) == UsbBulkPort.INTERFACE_NAME:
+                    return itf
+        except Exception:
+            pass  # no access to the device, or it can't be read
+        return None
+
+    # returns a list of the adapters found on the USB bus
+    @staticmethod
+    def find_all():
+        import usb.core
+        devices = usb.core.find(find_all=True, idVendor=UsbBulkPort.VID, idProduct=UsbBulkPort.PID,
+                                bcdDevice=UsbBulkPort.BCD_DEVICE)
+        return [dev for dev in devices if UsbBulkPort.bulk_interface(dev) is not None]
+
+    def write(self, data):
+        self.ep_out.write(data)
+
+    @property
+    def in_waiting(self):
+        import usb.core
+        try:
+            self.rx += self.ep_in.read(512, timeout=1)
+        except usb.core.USBTimeoutError:
+            pass
+        return len(self.rx)
+
+    def read(self, num_bytes):
+        data = bytes(self.rx[:num_bytes])
+        del self.rx[:num_bytes]
+        return data
+
+    def close(self):
+        pass  # the device stays open for the next command
+
+
+# instruction set of the adapter's program interpreter (see vm.h in the firmware)
+# each entry is the opcode, and the kinds of operand: r register, i 16-bit value, b byte, t jump target (a label)
+VM_OPS = {
+    "halt": (0x00, ""), "ldi": (0x01, "ri"), "ldhi": (0x02, "ri"), "mov": (0x03, "rr"),
+    "add": (0x04, "rrr"), "sub": (0x05, "rrr"), "and": (0x06, "rrr"), "or": (0x07, "rrr"),
+    "xor": (0x08, "rrr"), "shl": (0x09, "rrr"), "shr": (0x0A, "rrr"), "mul": (0x0B, "rrr"),
+    "addi": (0x0C, "ri"), "jmp": (0x10, "t"), "jeq": (0x11, "rrt"), "jne": (0x12, "rrt"),
+    "jlt": (0x13, "rrt"), "jge": (0x14, "rrt"), "jz": (0x15, "rt"), "jnz": (0x16, "rt"),
+    "call": (0x17, "t"), "ret": (0x18, ""), "push": (0x19, "r"), "pop": (0x1A, "r"),
+    "addr": (0x20, "b"), "addrr": (0x21, "r"), "rd8": (0x22, "rr"), "wr8": (0x23, "rr"),
+    "rd16": (0x24, "rr"), "wr16": (0x25, "rr"), "i2cw": (0x26, "bb"), "i2cr": (0x27, "bb"),
+    "ldm": (0x28, "rb"), "stm": (0x29, "rb"), "gpw": (0x30, "br"), "gpr": (0x31, "rb"),
+    "delay": (0x32, "r"), "delayi": (0x33, "i"), "out": (0x34, "r"),
+}
+
+# assembles a program for the adapter's interpreter, from text with one instruction per line,
+# for example "ldi r1, 0x75" or "jne r1, r2, not_found". A line ending in ':' is a label.
+# '#' starts a comment. Returns the program bytes
+def vm_assemble(source):
+    lines = []
+    labels = {}
+    for line in source.splitlines():
+        line = line.split("#")[0].strip()
+        if line == "":
+            continue
+        if line.endswith(":"):
+            labels[line[:-1].strip()] = len(lines)
+            continue
+        lines.append(line)
+    program = bytearray()
+    for n, line in enumerate(lines):
+        parts = line.replace(",", " ").split()
+        if parts[0].lower() not in VM_OPS:
+            raise ValueError(f"unknown instruction '{parts[0]}' in '{line}'")
+        opcode, kinds = VM_OPS[parts[0].lower()]
+        operands = parts[1:]
+        if len(operands) != len(kinds):
+            raise ValueError(f"expected {len(kinds)} operands in '{line}'")
+        fields = []  # bytes a, b, c
+        for kind, op in zip(kinds, operands):
+            if kind == "r":
+                fields.append(int(op.lower().lstrip("r")))
+            elif kind == "i":
+                v = int(op, 0) & 0xFFFF
+                fields += [v & 0xFF, v >> 8]
+            elif kind == "b":
+                fields.append(int(op, 0) & 0xFF)
+            else:
+                if op not in labels:
+                    raise ValueError(f"unknown label '{op}' in '{line}'")
+                fields.append(labels[op])
+        # jump targets are always in c, and i2cw, i2cr and delayi leave a unused
+        if kinds in ("t", "rt"):
+            fields = fields[:-1] + [0] * (3 - len(fields)) + fields[-1:]
+        elif kinds in ("bb", "i"):
+            fields = [0] + fields
+        fields += [0] * (3 - len(fields))
+        program += bytes([opcode] + fields)
+    return bytes(program)
+
+
 class EasyAdapter:
     def __init__(self):
         self.txterm = b"\r"
         self.adapter_port = None
+        self.usb_port = None  # set by find_usb_device, used instead of the serial port
+        self.stream_port = None  # the adapter's second serial port, which carries sample frames
         self.cmd_wait_period = 500
         self.dbg_print = False
 
+    # opens the connection to the adapter, either the serial port or the USB bulk interface
+    def open_port(self):
+        if self.usb_port is not None:
+            return self.usb_port
+        return serial.Serial(self.adapter_port, 115200, timeout=0.2)
+
     # sends a command and returns the serial buffer result
     def send_command(self, cmd):
         if self.adapter_port is None:
             print("No easy_adapter selected. Call find_device() first")
             return
-        ser = serial.Serial(self.adapter_port, 115200, timeout=0.2)
+        ser = self.open_port()
         if self.dbg_print:
             print(f"dbg send_command: {cmd}")
         ser.write(cmd.encode() + self.txterm)
@@ -34,37 +168,100 @@ class EasyAdapter:
     
     # sends a command and decodes the response (only use this function in m2m mode)
     # returns 1 if '.' is received, 2 if '&' is received,
-    # returns 3 if '~' (protocol error) received, 0 for general error
-    def send_and_confirm(self, cmd, wait_period=-1):
+    # returns 3 if '~' (protocol error) received, 4 if '!' (SMBus PEC error) received, 0 for general error
+    # if the line holds several commands, set count to the number of responses expected;
+    # the first response that isn't '.' is returned, otherwise the last one
+    def send_and_confirm(self, cmd, wait_period=-1, count=1):
         if self.adapter_port is None:
             print("No easy_adapter selected. Call find_device() first")
             return
         if wait_period < 0:
             wait_period = self.cmd_wait_period
-        ser = serial.Serial(self.adapter_port, 115200, timeout=0.2)
+        ser = self.open_port()
         if self.dbg_print:
             print(f"dbg send_and_confirm: {cmd}")
         ser.write(cmd.encode() + self.txterm)
         buffer = bytes()
         resp_found = 0
+        responses = 0
+        now = time.time_ns() // 1000000
+        while ((time.time_ns() // 1000000) - now) < wait_period:
+            if ser.in_waiting > 0:
+                data = ser.read(ser.in_waiting)
+                buffer += data
+                done = False
+                for ch in data:
+                    if ch not in b".&~X!":
+                        continue
+                    responses += 1
+                    resp_found = {ord("."): 1, ord("&"): 2, ord("~"): 3, ord("X"): 0, ord("!"): 4}[ch]
+                    if resp_found != 1 or responses >= count:
+                        done = True
+                        break
+                if done:
+                    break
+        ser.close()
+        if resp_found == 0:
+            print(f"Error, sent '{cmd}' but received '{buffer}'")
+        return resp_found
+
+    # sends many command lines without waiting for each response, then collects all the responses
+    # the adapter executes the lines in order, so the responses come back in the same order
+    # returns the raw response bytes
+    def send_pipelined(self, lines, wait_period=-1):
+        if self.adapter_port is None:
+            print("No easy_adapter selected. Call find_device() first")
+            return bytes()
+        if wait_period < 0:
+            wait_period = self.cmd_wait_period
+        ser = self.open_port()
+        ser.write(b"".join(line.encode() + self.txterm for line in lines))
+        buffer = bytes()
         now = time.time_ns() // 1000000
         while ((time.time_ns() // 1000000) - now) < wait_period:
             if ser.in_waiting > 0:
                 buffer += ser.read(ser.in_waiting)
-                if b"." in buffer:
+                now = time.time_ns() // 1000000  # wait until the adapter goes quiet
+        ser.close()
+        return buffer
+    
+    # sends a command and returns (result, payload) (only use this function in m2m mode)
+    # result is as for send_and_confirm, payload is any text received before the response character
+    def send_and_get_payload(self, cmd, wait_period=-1):
+        if self.adapter_port is None:
+            print("No easy_adapter selected. Call find_device() first")
+            return 0, b""
+        if wait_period < 0:
+            wait_period = self.cmd_wait_period
+        ser = self.open_port()
+        if self.dbg_print:
+            print(f"dbg send_and_get_payload: {cmd}")
+        ser.write(cmd.encode() + self.txterm)
+        buffer = bytes()
+        resp_found = 0
+        now = time.time_ns() // 1000000
+        while ((time.time_ns() // 1000000) - now) < wait_period:
+            if ser.in_waiting > 0:
+                buffer += ser.read(ser.in_waiting)
+                if buffer.endswith(b"."):
                     resp_found = 1
                     break
-                if b"&" in buffer:
+                if buffer.endswith(b"&"):
                     resp_found = 2
                     break
-                if b"~" in buffer:
+                if buffer.endswith(b"~"):
                     resp_found = 3
                     break
+                if buffer.endswith(b"!"):
+                    resp_found = 4
+                    break
+                if buffer.endswith(b"X"):
+                    break
         ser.close()
         if resp_found == 0:
             print(f"Error, sent '{cmd}' but received '{buffer}'")
-        return resp_found
-    
+        return resp_found, buffer[:-1]
+
     # finds the easy_adapter device by searching available COM ports.
     # this function is called automatically by init() so the user doesn't have to call it
     def find_device(self, board=0):
@@ -87,6 +284,8 @@ class EasyAdapter:
                 if found == 1:
                     print(f"Found easy_adapter_{board} at port {port.device}")
                     self.adapter_port = port.device
+                    self.stream_port = self.find_stream_port(port, ports)
+                    ser.close()
                     return port.device
                 else:
                     ser.close()
@@ -104,6 +303,52 @@ class EasyAdapter:
             print(f"No easy_adapter_{board} device found")
         return None
     
+    # waits for the easy_adapter device to appear, for instance after it has been reset or plugged in.
+    # the adapter accepts commands as soon as its USB port is enumerated. Returns the port, or None on timeout
+    def wait_for_device(self, board=0, timeout=10.0):
+        start = time.time()
+        while (time.time() - start) < timeout:
+            port = self.find_device(board)
+            if port is not None:
+                return port
+            time.sleep(0.2)
+        return None
+
+    # finds the adapter's streaming serial port: the other port with the same USB serial number,
+    # whose interface is named "Easy I2C Adapter data". Returns None if it can't be identified
+    def find_stream_port(self, control_port, ports):
+        if control_port.serial_number is None:
+            return None
+        for port in ports:
+            if port.device == control_port.device or port.serial_number != control_port.serial_number:
+                continue
+            if port.interface is not None and "data" in port.interface:
+                return port.device
+        return None
+
+    # finds the easy_adapter device through its USB bulk interface, instead of a serial port.
+    # this has lower latency than the serial port, and doesn't need a terminal to be closed.
+    # requires pyusb (and libusb). On Linux, a udev rule may be needed for non-root access
+    def find_usb_device(self, board=0):
+        try:
+            devices = UsbBulkPort.find_all()
+        except Exception as e:
+            print(f"Error: {e}")
+            return None
+        for dev in devices:
+            port = UsbBulkPort(dev)
+            port.write(self.txterm + b"device?" + self.txterm)
+            now = time.time_ns() // 1000000
+            while ((time.time_ns() // 1000000) - now) < self.cmd_wait_period:
+                port.in_waiting
+            if b"easy_adapter_" + str(board).encode() in port.read(port.in_waiting):
+                print(f"Found easy_adapter_{board} on USB bus {dev.bus} address {dev.address}")
+                self.usb_port = port
+                self.adapter_port = f"usb:{dev.bus}:{dev.address}"
+                return self.adapter_port
+        print(f"No easy_adapter_{board} device found on USB")
+        return None
+
     # enters or exits M2M mode, 1 for entering the mode, 0 for exiting
     def m2m_mode(self, val):
         cmd = f"m2m_resp:{val}"
@@ -116,8 +361,12 @@ class EasyAdapter:
                 print(f"Error exiting M2M mode")
     
     # tries an I2C address, returns True if the address is found, False otherwise
-    def i2c_try_address(self, addr):
+    # style can be "quick" (the default, address with the read bit), "write0" (zero-length write)
+    # or "read" (reads one byte)
+    def i2c_try_address(self, addr, style=None):
         cmd = f"tryaddr:0x{addr:02x}"
+        if style is not None:
+            cmd += f",{style}"
         result = self.send_and_confirm(cmd)
         if result == 1:
             return True
@@ -135,59 +384,22 @@ class EasyAdapter:
     # pass the first byte as data[0] and the rest as data[1:]
     # returns True if the command was successful, False otherwise
     def i2c_write(self, addr, byte1, data, hold=0):
-        cmd = f"addr:0x{addr:02x}"
-        result = self.send_and_confirm(cmd)
         num_bytes = len(data) + 1
-        cmd = f"bytes:{num_bytes}"
-        result = self.send_and_confirm(cmd)
-        if hold == 1:
-            cmd = f"send+hold {byte1:02x}"
-        else:
-            cmd = f"send {byte1:02x}"
-        # loop though the data, in groups of 16 bytes
-        for i in range(1, len(data)+1):
-            if (i) % 16 != 0:
-                if cmd == "":  # this is a new line, no need for preceding space
-                    cmd += f"{data[i-1]:02x}"
-                else:
-                    cmd += f" {data[i-1]:02x}"
-            else:
-                result = self.send_and_confirm(cmd, wait_period=2000)
-                cmd = ""
-                if i != len(data) - 1:
-                    if self.dbg_print:
-                        print(f"checking for &, i is {i}, len(data) is {len(data)}")
-                    # check if the result represents the '&' continuation character
-                    if result == 3:
-                        print("Protocol error, does the I2C device exist?")
-                        return False
-                    elif result != 2:
-                        print(f"Error sending. Expected 2(&) but received {result}")
-                        return False
-                    cmd = f"{data[i-1]:02x}"
-                else:
-                    # check if the result represents the '.' character
-                    if self.dbg_print:
-                        print(f"i is {i}, len(data) is {len(data)}")
-                        print("checking for .")
-                    if result == 3:
-                        print("Protocol error, does the I2C device exist?")
-                        return False
-                    elif result != 1:
-                        print(f"Error sending. Expected 1(.) but received {result}")
-                        return False
-        # send any remaining content if cmd is not empty
-        if cmd != "":
-            if self.dbg_print:
-                print("sending remainder")
-            result = self.send_and_confirm(cmd, wait_period=2000)
-            # check if the result represents contains the '.' character
-            if result == 3:
-                print("Protocol error, does the I2C device exist?")
-                return False
-            elif result != 1:
-                print(f"Error sending. Expected 1(.) but received {result}")
-                return False
+        if num_bytes > 256:
+            print("Error, at most 256 bytes can be sent in one write")
+            return False
+        op = "send+hold" if hold == 1 else "send"
+        # the adapter executes each token as it arrives, so the whole write fits on one line
+        cmd = f"addr:0x{addr:02x} bytes:{num_bytes} {op} {byte1:02x}"
+        for b in data:
+            cmd += f" {b:02x}"
+        result = self.send_and_confirm(cmd, wait_period=2000, count=3)
+        if result == 3:
+            print("Protocol error, does the I2C device exist?")
+            return False
+        elif result != 1:
+            print(f"Error sending. Expected 1(.) but received {result}")
+            return False
         if self.dbg_print:
             print("done!")
         return True
@@ -199,15 +411,13 @@ class EasyAdapter:
     # returns None if the read was unsuccessful
     def i2c_read(self, addr, num_bytes):
         status = False
-        cmd = f"addr:0x{addr:02x}"
-        result = self.send_and_confirm(cmd)
-        cmd = f"bytes:{num_bytes}"
-        result = self.send_and_confirm(cmd)
+        cmd = f"addr:0x{addr:02x} bytes:{num_bytes}"
+        result = self.send_and_confirm(cmd, count=2)
         cmd = "recv"
         if self.adapter_port is None:
             print("No easy_adapter selected. Call find_device() first")
             return
-        ser = serial.Serial(self.adapter_port, 115200, timeout=0.2)
+        ser = self.open_port()
         if self.dbg_print:
             print(f"dbg i2c_read: {cmd}")
         ser.write(cmd.encode() + self.txterm)
@@ -274,6 +484,558 @@ class EasyAdapter:
         else:
             return -1
     
+    # writes data to a 24Cxx style EEPROM, starting at memory address start
+    # awidth: number of memory address bytes (1 or 2), page: EEPROM page size in bytes
+    # the adapter splits the data at page boundaries and waits for each internal write cycle itself
+    # returns the time taken by the adapter in microseconds, or None if unsuccessful
+    def eeprom_write(self, addr, start, data, awidth=2, page=64):
+        self.send_and_confirm(f"addr:0x{addr:02x}")
+        self.send_and_confirm(f"bytes:{len(data)}")
+        prefix = f"eewrite:0x{start:x},{awidth},{page}"
+        # lines can be any length, they are only split to bound how long each confirmation takes
+        for i in range(0, len(data), 1024):
+            cmd = " ".join(f"{b:02x}" for b in data[i:i+1024])
+            if prefix != "":
+                cmd = prefix + " " + cmd
+                prefix = ""
+            result, payload = self.send_and_get_payload(cmd, wait_period=5000)
+            if result == 3:
+                print("Protocol error writing EEPROM, does the I2C device exist?")
+                return None
+            if i + 1024 < len(data):
+                if result != 2:
+                    print(f"Error writing EEPROM. Expected 2(&) but received {result}")
+                    return None
+            elif result != 1:
+                print(f"Error writing EEPROM. Expected 1(.) but received {result}")
+                return None
+        fields = payload.decode().split(",")
+        return int(fields[1])
+
+    # reads num_bytes from a memory device starting at memory address start, and returns the CRC
+    # computed on the adapter, so that the data itself does not need to be transferred
+    # awidth: number of memory address bytes (0, 1 or 2; 0 means read from the current position)
+    # crc: 32 for CRC-32 (as used by zlib.crc32), 16 for CRC-16/CCITT-FALSE
+    # returns None if unsuccessful
+    def mem_crc(self, addr, start, num_bytes, awidth=2, crc=32):
+        self.send_and_confirm(f"addr:0x{addr:02x}")
+        result, payload = self.send_and_get_payload(f"crc{crc}:0x{start:x},{awidth},{num_bytes}", wait_period=10000)
+        if result != 1:
+            print("mem_crc was unsuccessful")
+            return None
+        return int(payload.decode(), 16)
+
+    # reads num_bytes from a memory device and compares them on the adapter against a pattern
+    # pattern: "const", "inc" or "lfsr" (generated from param), or a list of bytes which is uploaded and repeated
+    # returns (mismatch_count, runs) where runs is a list of (offset, length, first_actual_values),
+    # or None if unsuccessful
+    def mem_compare(self, addr, start, num_bytes, pattern, param=0, awidth=2):
+        if isinstance(pattern, (list, bytes, bytearray)):
+            self.send_and_confirm(f"bytes:{len(pattern)}")
+            cmd = "pattern " + " ".join(f"{b:02x}" for b in pattern)
+            if self.send_and_confirm(cmd) != 1:
+                print("Error uploading pattern")
+                return None
+            pattern = "buf"
+        self.send_and_confirm(f"addr:0x{addr:02x}")
+        result, payload = self.send_and_get_payload(f"cmp:0x{start:x},{awidth},{num_bytes},{pattern},{param}",
+                                                    wait_period=10000)
+        if result != 1:
+            print("mem_compare was unsuccessful")
+            return None
+        runs = []
+        count = 0
+        for field in payload.decode().split():
+            if field.startswith("@"):
+                location, values = field[1:].split("=")
+                offset, length = location.split(":")
+                runs.append((int(offset, 16), int(length, 16), bytes.fromhex(values)))
+            elif field.startswith("#"):
+                count = int(field[1:], 16)
+        return count, runs
+
+    # generates the same byte sequence as the adapter's lfsr compare pattern, for writing test data
+    def lfsr_pattern(self, seed, num_bytes):
+        state = seed if seed != 0 else 0xACE1
+        data = []
+        for i in range(num_bytes):
+            state = (state >> 1) ^ (0xB400 if state & 1 else 0)
+            data.append(state & 0xff)
+        return data
+
+    # starts a periodic sampling job on the adapter (job is 0 to 3)
+    # every period_us microseconds, num_bytes are read from addr, after writing reg (if reg is not None)
+    # the samples are streamed back as binary frames, use sample_read() to collect them
+    def sample_start(self, job, addr, period_us, num_bytes, reg=None):
+        self.send_and_confirm(f"addr:0x{addr:02x}")
+        cmd = f"sample:{job},{period_us},{num_bytes}"
+        if reg is not None:
+            cmd += f",0x{reg:02x}"
+        result = self.send_and_confirm(cmd)
+        return result == 1
+
+    # stops a sampling job, or all jobs if job is None. Any frames still in flight are discarded
+    def sample_stop(self, job=None):
+        if job is None:
+            cmd = "sample_stop:all"
+        else:
+            cmd = f"sample_stop:{job}"
+        self.send_command(cmd)
+        return True
+
+    # attaches a triggered read to a GPIO pin (trigger n is 0 to 3)
+    # on each edge ("rise", "fall" or "both"), num_bytes are read from addr, after writing reg (if reg is not None)
+    # results arrive as sample frames (see sample_read), with 0x80 added to the job number
+    def trigger_start(self, n, gpio_num, edge, addr, num_bytes, reg=None):
+        self.send_and_confirm(f"addr:0x{addr:02x}")
+        cmd = f"trig:{n},{gpio_num},{edge},{num_bytes}"
+        if reg is not None:
+            cmd += f",0x{reg:02x}"
+        result = self.send_and_confirm(cmd)
+        return result == 1
+
+    # detaches a trigger, or all triggers if n is None
+    def trigger_stop(self, n=None):
+        if n is None:
+            cmd = "trig_stop:all"
+        else:
+            cmd = f"trig_stop:{n}"
+        self.send_command(cmd)
+        return True
+
+    # CRC-16/CCITT-FALSE, as used by the adapter's binary frames
+    def crc16(self, data):
+        crc = 0xffff
+        for b in data:
+            crc ^= b << 8
+            for i in range(8):
+                crc = ((crc << 1) ^ 0x1021) & 0xffff if crc & 0x8000 else (crc << 1) & 0xffff
+        return crc
+
+    # collects sample frames for duration_s seconds
+    # returns a list of (job, seq, timestamp_us, overruns, data) tuples
+    # if the adapter's streaming port was found, frames are read from it, and command responses are unaffected
+    def sample_read(self, duration_s):
+        samples = []
+        if self.adapter_port is None:
+            print("No easy_adapter selected. Call find_device() first")
+            return samples
+        if self.stream_port is not None:
+            ser = serial.Serial(self.stream_port, 115200, timeout=0.2)
+        else:
+            ser = self.open_port()
+        buffer = bytes()
+        end = time.time() + duration_s
+        while time.time() < end:
+            if ser.in_waiting > 0:
+                buffer += ser.read(ser.in_waiting)
+            while True:
+                start = buffer.find(b"\xa5\x5a")
+                if start < 0 or len(buffer) < start + 12:
+                    break
+                length = buffer[start + 11]
+                frame_end = start + 12 + length + 2
+                if len(buffer) < frame_end:
+                    break
+                body = buffer[start + 2:frame_end - 2]
+                crc = buffer[frame_end - 2] | (buffer[frame_end - 1] << 8)
+                if self.crc16(body) != crc:
+                    buffer = buffer[start + 1:]  # not a frame, resynchronise
+                    continue
+                job = body[0]
+                seq = body[1] | (body[2] << 8)
+                timestamp = int.from_bytes(body[3:7], "little")
+                overruns = body[7] | (body[8] << 8)
+                samples.append((job, seq, timestamp, overruns, body[10:]))
+                buffer = buffer[frame_end:]
+        ser.close()
+        return samples
+
+    # waits on the adapter until (register value & mask) == value, reading every interval_us microseconds
+    # returns (met, last_value, reads, elapsed_us), where met is False on timeout, or None if unsuccessful
+    def wait_register(self, addr, reg, mask, value, interval_us=100, timeout_ms=1000):
+        self.send_and_confirm(f"addr:0x{addr:02x}")
+        cmd = f"waitreg:0x{reg:02x},0x{mask:02x},0x{value:02x},{interval_us},{timeout_ms}"
+        result, payload = self.send_and_get_payload(cmd, wait_period=timeout_ms + self.cmd_wait_period)
+        if result == 3 or payload == b"":
+            print("wait_register was unsuccessful")
+            return None
+        fields = payload.decode().split(",")
+        return result == 1, int(fields[0], 16), int(fields[1]), int(fields[2])
+
+    # returns the adapter's clock, in microseconds since it was powered on
+    def adapter_time(self):
+        result, payload = self.send_and_get_payload("time?")
+        if result != 1:
+            return None
+        return int(payload.decode())
+
+    # queues an I2C write of up to 16 bytes, to start at adapter time deadline_us (see adapter_time)
+    # if relative is True, deadline_us is a delay from now instead
+    # returns the transaction id, or None if unsuccessful
+    def i2c_write_at(self, addr, data, deadline_us, relative=False):
+        self.send_and_confirm(f"addr:0x{addr:02x}")
+        self.send_and_confirm(f"bytes:{len(data)}")
+        if relative:
+            self.send_and_confirm(f"at:+{deadline_us}")
+        else:
+            self.send_and_confirm(f"at:{deadline_us}")
+        cmd = "send " + " ".join(f"{b:02x}" for b in data)
+        result, payload = self.send_and_get_payload(cmd)
+        if result != 1:
+            print("i2c_write_at was unsuccessful")
+            return None
+        return int(payload.decode())
+
+    # returns a list of (id, start_us, late_us, status) for completed scheduled writes
+    # status is 0 for success, 1 for a protocol error, 2 if cancelled
+    def sched_results(self):
+        result, payload = self.send_and_get_payload("sched?")
+        entries = []
+        if result != 1:
+            return entries
+        for field in payload.decode().split():
+            values = field.split(",")
+            entries.append((int(values[0]), int(values[1]), int(values[2]), int(values[3])))
+        return entries
+
+    # configures waveform playback to the device at addr
+    # each sample is frame_bytes bytes (1 to 4), written after reg (None for no register byte), at rate_hz
+    # with loop=1 the uploaded buffer repeats; with loop=0 it is streamed in two halves (see wave_stream)
+    # returns the number of samples that fit (per half when streaming), or None if unsuccessful
+    def wave_config(self, addr, frame_bytes, rate_hz, reg=None, loop=1):
+        self.send_and_confirm(f"addr:0x{addr:02x}")
+        if reg is None:
+            reg = -1
+        result, payload = self.send_and_get_payload(f"wave_cfg:{reg},{frame_bytes},{rate_hz},{loop}")
+        if result != 1:
+            print("wave_config was unsuccessful")
+            return None
+        return int(payload.decode())
+
+    # uploads waveform bytes (a whole number of frames). Returns False if there is no room yet
+    def wave_fill(self, data):
+        self.send_and_confirm(f"bytes:{len(data)}")
+        prefix = "wave_fill"
+        for i in range(0, len(data), 1024):
+            cmd = prefix + " " + " ".join(f"{b:02x}" for b in data[i:i+1024])
+            prefix = ""
+            result = self.send_and_confirm(cmd.strip())
+            if result == 0:
+                return False
+            if i + 1024 < len(data) and result != 2:
+                return False
+        return result == 1
+
+    def wave_start(self):
+        return self.send_and_confirm("wave_start") == 1
+
+    def wave_stop(self):
+        return self.send_and_confirm("wave_stop") == 1
+
+    # returns (playing, samples_played, underruns, errors, free_halves)
+    def wave_status(self):
+        result, payload = self.send_and_get_payload("wave?")
+        if result != 1:
+            return None
+        fields = payload.decode().split(",")
+        return tuple(int(f) for f in fields)
+
+    # streams a long waveform: data is split into half-buffer blocks that are uploaded
+    # whenever the adapter has a free half. Call wave_config with loop=0 first
+    def wave_stream(self, data, frame_bytes, samples_per_half):
+        block = frame_bytes * samples_per_half
+        blocks = [data[i:i+block] for i in range(0, len(data), block)]
+        # fill both halves before starting
+        for b in blocks[:2]:
+            self.wave_fill(b)
+        self.wave_start()
+        for b in blocks[2:]:
+            while True:
+                status = self.wave_status()
+                if status is not None and status[4] > 0:
+                    break
+                time.sleep(0.005)
+            self.wave_fill(b)
+        while True:
+            status = self.wave_status()
+            if status is None or status[4] == 2:
+                break
+            time.sleep(0.005)
+        self.wave_stop()
+
+    # enables (1) or disables (0) the register shadow cache on the adapter
+    # while enabled, register writes that match the cached value are not sent on the I2C bus,
+    # and register reads (i2c_write with hold=1, then i2c_read) of non-volatile registers are answered from the cache
+    # disabling the cache clears it
+    def cache_enable(self, val):
+        result = self.send_and_confirm(f"cache:{val}")
+        return result == 1
+
+    # marks a register as non-volatile (nv=1), so that reads of it may be served from the cache,
+    # or volatile (nv=0)
+    def cache_nonvolatile(self, addr, reg, nv=1):
+        self.send_and_confirm(f"addr:0x{addr:02x}")
+        if nv == 1:
+            result = self.send_and_confirm(f"cache_nv:0x{reg:02x}")
+        else:
+            result = self.send_and_confirm(f"cache_vol:0x{reg:02x}")
+        return result == 1
+
+    # forgets cached register values, for example after a device reset
+    # with no parameters, every device is invalidated; with addr only, all registers at that address
+    def cache_invalidate(self, addr=None, reg=None):
+        if addr is None:
+            result = self.send_and_confirm("cache_inv:all")
+            return result == 1
+        self.send_and_confirm(f"addr:0x{addr:02x}")
+        if reg is None:
+            result = self.send_and_confirm("cache_inv")
+        else:
+            result = self.send_and_confirm(f"cache_inv:0x{reg:02x}")
+        return result == 1
+
+    # changes a setting that the adapter uses from startup: field is "m2m", "echo", "pullup" (0 or 1),
+    # "id" (software board ID, or -1 to use the pins), "baud" (I2C clock in Hz)
+    # or "macro" (commands run at startup, separated by ';'). Call config_save to keep the changes
+    # a long macro is sent in pieces, since each command the adapter receives is limited to 64 characters
+    def config_set(self, field, value):
+        if field == "macro":
+            value = str(value)
+            result = self.send_and_confirm(f"cfg:macro,{value[:50]}")
+            for i in range(50, len(value), 50):
+                if result != 1:
+                    break
+                result = self.send_and_confirm(f"cfg:macro+,{value[i:i + 50]}")
+            return result == 1
+        result = self.send_and_confirm(f"cfg:{field},{value}")
+        return result == 1
+
+    # writes the startup settings to the adapter's flash
+    def config_save(self):
+        result = self.send_and_confirm("cfg_save", wait_period=500)
+        return result == 1
+
+    # erases the stored settings, so the adapter uses its defaults from the next startup
+    def config_reset(self):
+        result = self.send_and_confirm("cfg_reset", wait_period=500)
+        return result == 1
+
+    # returns the startup settings as a dictionary, or None if unsuccessful
+    def config_get(self):
+        result, payload = self.send_and_get_payload("cfg?")
+        if result != 1:
+            return None
+        fields = payload.decode().split(",", 6)
+        return {"m2m": int(fields[0]), "echo": int(fields[1]), "pullup": int(fields[2]), "id": int(fields[3]),
+                "baud": int(fields[4]), "slots_used": int(fields[5]), "macro": fields[6]}
+
+    # stores a script on the adapter, in slot script_id (0 to 7), so that it can be run with script_run
+    # lines is a list of command lines; $0 to $7 in a command are replaced by the parameters given to script_run,
+    # loop:<count> ... endloop repeats commands, delay:<us> waits
+    def script_store(self, script_id, lines, name=""):
+        result = self.send_and_confirm(f"script_begin:{script_id},{name}")
+        if result != 2:
+            print("script_store was unsuccessful")
+            return False
+        for line in lines:
+            result = self.send_and_confirm(line)
+            if result != 2:
+                print(f"Error storing script line '{line}'")
+                return False
+        result = self.send_and_confirm("script_end", wait_period=500)
+        return result == 1
+
+    # runs a stored script, returns (success, number of steps run, list of command outputs)
+    # for instance the data read by each recv
+    def script_run(self, script_id, *params, wait_period=5000):
+        cmd = f"run:{script_id}"
+        for p in params:
+            cmd += f",{p}"
+        result, payload = self.send_and_get_payload(cmd, wait_period=wait_period)
+        fields = payload.decode().split(";")
+        try:
+            steps = int(fields[0])
+        except ValueError:
+            return False, 0, []
+        return result == 1, steps, fields[1:]
+
+    # returns a list of (script_id, name, length) for the stored scripts
+    def script_list(self):
+        result, payload = self.send_and_get_payload("script?")
+        scripts = []
+        if result != 1:
+            return scripts
+        for field in payload.decode().split():
+            values = field.split(",")
+            scripts.append((int(values[0]), values[1], int(values[2])))
+        return scripts
+
+    # deletes a stored script
+    def script_delete(self, script_id):
+        result = self.send_and_confirm(f"script_del:{script_id}", wait_period=500)
+        return result == 1
+
+    # sets the number of commands and loop passes a script run may take (100000 by default)
+    def script_set_limit(self, steps):
+        result = self.send_and_confirm(f"script_limit:{steps}")
+        return result == 1
+
+    # uploads a program for the adapter's interpreter (see vm_assemble). The adapter checks every instruction
+    # before accepting it. Returns True if successful
+    def vm_load(self, program):
+        self.send_and_confirm(f"bytes:{len(program)}")
+        cmd = "vm_load " + " ".join(f"{b:02x}" for b in program)
+        result, payload = self.send_and_get_payload(cmd, wait_period=2000)
+        if result != 1:
+            print(f"vm_load was unsuccessful, invalid instruction {payload.decode()}")
+            return False
+        return True
+
+    # sets the maximum number of instructions that a program run can execute
+    def vm_set_limit(self, steps):
+        result = self.send_and_confirm(f"vm_limit:{steps}")
+        return result == 1
+
+    # runs the uploaded program, with registers r0 upwards set to args (up to 8)
+    # returns (status, steps, r0, output bytes); status is 0 if the program completed
+    def vm_run(self, *args, wait_period=5000):
+        cmd = "vm_run"
+        if len(args) > 0:
+            cmd += ":" + ",".join(str(a) for a in args)
+        result, payload = self.send_and_get_payload(cmd, wait_period=wait_period)
+        fields = payload.decode().split(",")
+        if len(fields) < 5:
+            return None
+        return int(fields[0]), int(fields[1]), int(fields[3]), bytes.fromhex(fields[4])
+
+    # enables (1) or disables (0) the SMBus packet error check (PEC) for the smbus_ functions
+    # with PEC on, a PEC byte is added to writes and checked on reads
+    def smbus_pec(self, val):
+        result = self.send_and_confirm(f"smb_pec:{val}")
+        return result == 1
+
+    # performs an SMBus transfer, returns the payload (bytes) or None if unsuccessful
+    def smbus_transfer(self, addr, op, code=None, value=None, data=None):
+        self.send_and_confirm(f"addr:0x{addr:02x}")
+        cmd = f"smb:{op}"
+        if code is not None:
+            cmd += f",0x{code:02x}"
+        if value is not None:
+            cmd += f",0x{value:x}"
+        if data is not None:
+            self.send_and_confirm(f"bytes:{len(data)}")
+            cmd += " " + " ".join(f"{b:02x}" for b in data)
+        result, payload = self.send_and_get_payload(cmd)
+        if result == 4:
+            print(f"SMBus PEC error for {cmd}")
+            return None
+        if result != 1:
+            print(f"SMBus transfer {cmd} was unsuccessful")
+            return None
+        return bytes.fromhex(payload.decode())
+
+    # SMBus quick command (write), returns True if the device acknowledged
+    def smbus_quick(self, addr):
+        return self.smbus_transfer(addr, "quick") is not None
+
+    def smbus_send_byte(self, addr, code):
+        return self.smbus_transfer(addr, "send", code) is not None
+
+    def smbus_receive_byte(self, addr):
+        r = self.smbus_transfer(addr, "recv")
+        return None if r is None else r[0]
+
+    def smbus_write_byte(self, addr, code, value):
+        return self.smbus_transfer(addr, "wrb", code, value) is not None
+
+    def smbus_read_byte(self, addr, code):
+        r = self.smbus_transfer(addr, "rdb", code)
+        return None if r is None else r[0]
+
+    def smbus_write_word(self, addr, code, value):
+        return self.smbus_transfer(addr, "wrw", code, value) is not None
+
+    # the word is returned as a value (the adapter has already combined the LSB and MSB)
+    def smbus_read_word(self, addr, code):
+        r = self.smbus_transfer(addr, "rdw", code)
+        return None if r is None else int.from_bytes(r, "big")
+
+    def smbus_process_call(self, addr, code, value):
+        r = self.smbus_transfer(addr, "call", code, value)
+        return None if r is None else int.from_bytes(r, "big")
+
+    def smbus_block_write(self, addr, code, data):
+        return self.smbus_transfer(addr, "bwr", code, data=data) is not None
+
+    def smbus_block_read(self, addr, code):
+        return self.smbus_transfer(addr, "brd", code)
+
+    def smbus_block_process_call(self, addr, code, data):
+        return self.smbus_transfer(addr, "bcall", code, data=data)
+
+    # watches a GPIO pin for SMBALERT#. On each alert the adapter finds the device(s) using the
+    # Alert Response Address, and reads status_len bytes from each, after writing status_reg (if not None)
+    # events arrive as sample frames with job 0x40, use alert_read() to collect them
+    def alert_start(self, gpio_num, status_len=0, status_reg=None):
+        cmd = f"alert:{gpio_num},{status_len}"
+        if status_reg is not None:
+            cmd += f",0x{status_reg:02x}"
+        result = self.send_and_confirm(cmd)
+        return result == 1
+
+    def alert_stop(self):
+        result = self.send_and_confirm("alert_stop")
+        return result == 1
+
+    # returns (gpio, events, lost), or None if the adapter isn't watching for SMBALERT#
+    def alert_status(self):
+        result, payload = self.send_and_get_payload("alert?")
+        if result != 1 or payload == b"-":
+            return None
+        return tuple(int(f) for f in payload.decode().split(","))
+
+    # collects alert events for duration_s seconds (any other sample frames are discarded)
+    # returns a list of (timestamp_us, device_addr, status) tuples. device_addr is 0xff if the
+    # line was low but no device answered the Alert Response Address
+    def alert_read(self, duration_s):
+        events = []
+        for job, seq, timestamp, overruns, data in self.sample_read(duration_s):
+            if job == 0x40 and len(data) > 0:
+                events.append((timestamp, data[0], data[1:]))
+        return events
+
+    # registers an I2C mux (n is 0 to 3) at addr. mux_type is "switch" for the TCA9548A and PCA9548A/9546A/9545A/9543A
+    # (a channel mask), or "select" for the PCA9544A/9542A (an enable bit and channel number)
+    def mux_register(self, n, addr, mux_type="switch"):
+        result = self.send_and_confirm(f"mux:{n},0x{addr:02x},{mux_type}")
+        return result == 1
+
+    def mux_remove(self, n):
+        result = self.send_and_confirm(f"mux:{n},off")
+        return result == 1
+
+    # sets the current I2C address to a device behind a mux. The adapter only writes to the mux
+    # if the channel isn't already selected, and deselects the other muxes
+    def mux_address(self, n, channel, addr):
+        result = self.send_and_confirm(f"addr:{n},{channel},0x{addr:02x}")
+        return result == 1
+
+    # deselects every channel of every registered mux
+    def mux_off(self):
+        result = self.send_and_confirm("mux_off")
+        return result == 1
+
+    # returns (writes, skipped, muxes), where muxes is a list of (n, addr, type, control byte or -1)
+    def mux_status(self):
+        result, payload = self.send_and_get_payload("mux?")
+        if result != 1:
+            return None
+        fields = payload.decode().split(";")
+        writes, skipped = (int(f) for f in fields[0].split(","))
+        muxes = [tuple(int(v) for v in f.split(",")) for f in fields[1:]]
+        return writes, skipped, muxes
+
     # this function is used to locate the easy_adapter, and to set it to M2M mode
     # the board value is between 0 and 7 (multiple easy_adapters can be connected to the PC)
     # the board value is set using certain GPIO pins shorted to ground 
@@ -289,8 +1051,12 @@ class EasyAdapter:
     # 1      0      1       2
     # 1      1      0       1
     # 1      1      1       0
-    def init(self, board=0):
-        res = self.find_device(board)
+    # set usb to True to use the USB bulk interface (see find_usb_device) rather than the serial port
+    def init(self, board=0, usb=False):
+        if usb:
+            res = self.find_usb_device(board)
+        else:
+            res = self.find_device(board)
         if res is None:
             return False
         self.m2m_mode(1)